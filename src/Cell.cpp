@@ -1,50 +1,141 @@
 #include "Cell.hpp"
+#include "Sorted.hpp"
 #include <limits>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
 
-static uint8_t refs[NUM_OBJ] = {0};
-refnum leftmostRef = 1;
+static Heap mainHeap;
+thread_local Heap* heap = &mainHeap;
+thread_local uint32_t liztTag = 0;
+static Heap* heaps[MAX_HEAPS] = {&mainHeap};
+static mutex heapsLock;
 
-static refnum newRef () {
-  refnum ref = leftmostRef++;
-  while (refs[ref] && ref < NUM_OBJ)
+Heap::Heap () {
+  if (this == &mainHeap) return;
+  lock_guard<mutex> l(heapsLock);
+  for (uint16_t i = 1; i < MAX_HEAPS; ++i)
+    if (!heaps[i]) {
+      heaps[id = i] = this;
+      return;
+    }
+  full = true;
+}
+
+Heap::~Heap () {
+  if (this == &mainHeap || full) return;
+  lock_guard<mutex> l(heapsLock);
+  heaps[id] = nullptr;
+}
+
+//While shared, slots are claimed by compare-and-swap,
+//  and leftmostRef is only a hint of where to start looking.
+//  Returns 0, which is never counted or freed, if all are in use
+refnum Heap::newRef () {
+  if (!shared) {
+    refnum ref = leftmostRef;
+    while (ref < NUM_OBJ && refs[ref])
+      ++ref;
+    if (ref == NUM_OBJ) return 0;
+    refs[ref] = 1;
+    hashes[ref] = 0;
+    leftmostRef = ref + 1;
+    return ref;
+  }
+  refnum ref = __atomic_load_n(&leftmostRef, __ATOMIC_RELAXED);
+  for (refnum tries = 1;; ++tries) {
+    if (tries == NUM_OBJ) return 0;
+    if (ref >= NUM_OBJ || !ref) ref = 1;
+    uint32_t free = 0;
+    if (__atomic_compare_exchange_n(&refs[ref], &free, 1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      break;
     ++ref;
+  }
+  __atomic_store_n(&hashes[ref], 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&leftmostRef, ref + 1, __ATOMIC_RELAXED);
   return ref;
 }
 
+void Heap::retain (refnum ref) {
+  if (!ref) return;
+  if (shared) __atomic_add_fetch(&refs[ref], 1, __ATOMIC_RELAXED);
+  else ++refs[ref];
+}
+
+//Returns true if this was the last reference
+bool Heap::release (refnum ref) {
+  if (!shared) {
+    if (!refs[ref] || --refs[ref]) return false;
+    if (ref < leftmostRef)
+      leftmostRef = ref;
+    return true;
+  }
+  if (!__atomic_load_n(&refs[ref], __ATOMIC_RELAXED)
+   || __atomic_sub_fetch(&refs[ref], 1, __ATOMIC_ACQ_REL)) return false;
+  refnum left = __atomic_load_n(&leftmostRef, __ATOMIC_RELAXED);
+  while (ref < left && !__atomic_compare_exchange_n(&leftmostRef, &left, ref, true,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return true;
+}
+
+bool Heap::hasLeak () {
+  refnum ref = 0;
+  while (ref < NUM_OBJ && !refs[ref++]);
+  return ref != NUM_OBJ;
+}
+
+Heap* Heap::at (uint8_t id) {
+  return heaps[id];
+}
+
 void Value::setRef () {
-  if (_type == T_Cell || _type == T_Lamb || _type == T_Str || _type == T_Vec || _type == T_Lizt)
-    refs[_ref = newRef()] = 1;
+  if (_type == T_Cell || _type == T_Lamb || _type == T_Str || _type == T_Vec || _type == T_Lizt
+   || _type == T_Pack || _type == T_Future || _type == T_Map || _type == T_Set || _type == T_SMap || _type == T_SSet || _type == T_Rope
+   || _type == T_Rec || _type == T_Thunk) {
+    _heap = heap->id;
+    _ref = heap->newRef();
+  }
 }
 
 Value::Value (Data d, Type t) : _data(d), _type(t) {
   setRef();
 }
 Value::Value (const Value& obj)
-  : _ref(obj._ref), _data(obj._data), _type(obj._type) {
-  if (_ref) ++refs[_ref];
+  : _ref(obj._ref), _heap(obj._heap), _data(obj._data), _type(obj._type) {
+  if (_ref) Heap::at(_heap)->retain(_ref);
 }
 Value& Value::operator= (const Value& obj) {
   this->~Value();
   _data = obj._data;
   _type = obj._type;
   _ref = obj._ref;
-  if (_ref) ++refs[_ref];
+  _heap = obj._heap;
+  if (_ref) Heap::at(_heap)->retain(_ref);
   return *this;
 }
 
 Value::~Value () {
-  if (!_ref || !refs[_ref] || --refs[_ref]) return;
+  if (!_ref || !Heap::at(_heap)->release(_ref)) return;
 //if (type == T_Cell || type == T_Str || type == T_Lamb || type == T_Vec)
 //  printf("haha %d\n", type);
   switch (_type) {
     case T_Cell: delete cell(); break;
     case T_Lamb: delete cell(); break;
     case T_Str:  delete (string*)_data.ptr; break;
-    case T_Vec:  delete (immer::vector<Value>*)_data.ptr; break;
+    case T_Vec:  delete (immer::flex_vector<Value>*)_data.ptr; break;
     case T_Lizt: delete (Lizt*)_data.ptr; break;
+    case T_Pack: delete (Pack*)_data.ptr; break;
+    case T_Future: deleteFuture((Future*)_data.ptr); break;
+    case T_Map:  delete (HashMap*)_data.ptr; break;
+    case T_Set:  delete (HashSet*)_data.ptr; break;
+    case T_SMap: case T_SSet:
+                 delete (Sorted*)_data.ptr; break;
+    case T_Rope: delete (Rope*)_data.ptr; break;
+    case T_Rec:  Record::free((Record*)_data.ptr); break;
+    case T_Thunk: deleteThunk((Thunk*)_data.ptr); break;
   }
-  if (_ref < leftmostRef)
-    leftmostRef = _ref;
 }
 
 
@@ -53,9 +144,423 @@ void Value::kill () {
   _type = T_N;
 }
 
+string Value::str () {
+  return _type == T_Rope ? ((Rope*)_data.ptr)->str() : *(string*)_data.ptr;
+}
+
+//Returns true if this is the only reference to its object
+bool Value::isUnique () {
+  return _ref && Heap::at(_heap)->refs[_ref] == 1;
+}
+
+//Vectors keep their hash in their heap by refnum, as they are never changed
+size_t Value::cachedHash () {
+  if (_type == T_Pack) return pack(*this)->hash;
+  if (_type != T_Vec || !_ref) return 0;
+  return __atomic_load_n(&Heap::at(_heap)->hashes[_ref], __ATOMIC_RELAXED);
+}
+
+void Value::cacheHash (size_t h) {
+  if (_type == T_Pack) pack(*this)->hash = h;
+  else if (_type == T_Vec && _ref)
+    __atomic_store_n(&Heap::at(_heap)->hashes[_ref], h, __ATOMIC_RELAXED);
+}
+
+
+immer::flex_vector<Value>* vec (Value &v) {
+  return (immer::flex_vector<Value>*)v.ptr();
+}
+
+Pack* pack (Value &v) {
+  return (Pack*)v.ptr();
+}
+
+Rope* Rope::append (const string &s) const {
+  lock_guard<mutex> l(buf->lock);
+  if (buf->data.size() == len) {
+    buf->data += s;
+    return new Rope{buf, len + s.size()};
+  }
+  auto copy = make_shared<Buf>();
+  copy->data.reserve((len + s.size()) * 2);
+  copy->data.append(buf->data, 0, len);
+  copy->data += s;
+  return new Rope{copy, len + s.size()};
+}
+
+string Rope::str () const {
+  lock_guard<mutex> l(buf->lock);
+  return buf->data.substr(0, len);
+}
+
+char Rope::at (size_t i) const {
+  lock_guard<mutex> l(buf->lock);
+  return buf->data[i];
+}
+
+Rope* rope (Value &v) {
+  return (Rope*)v.ptr();
+}
+
+static Layout* layouts[MAX_LAYOUTS];
+static atomic<uint16_t> numLayouts {0};
+static mutex layoutsLock;
+
+int32_t Layout::add (const string &name, vector<string> fields) {
+  lock_guard<mutex> l(layoutsLock);
+  int32_t id = find(name);
+  if (id >= 0 && layouts[id]->fields == fields)
+    return id;
+  uint16_t n = numLayouts;
+  if (n == MAX_LAYOUTS) return -1;
+  layouts[n] = new Layout{name, fields};
+  numLayouts = n + 1; //Published after the layout is complete
+  return n;
+}
+
+int32_t Layout::find (const string &name) {
+  for (int32_t i = numLayouts - 1; i >= 0; --i)
+    if (layouts[i]->name == name)
+      return i;
+  return -1;
+}
+
+Layout* Layout::at (uint16_t id) {
+  return id < numLayouts ? layouts[id] : nullptr;
+}
+
+uint16_t Layout::count () {
+  return numLayouts;
+}
 
-immer::vector<Value>* vec (Value &v) {
-  return (immer::vector<Value>*)v.ptr();
+Record* Record::make (uint16_t layout, uint16_t size) {
+  void* mem = ::operator new(sizeof(Record) + size * sizeof(Value));
+  Record* r = new (mem) Record{layout, size};
+  for (uint16_t f = 0; f < size; ++f)
+    new (&r->fields()[f]) Value();
+  return r;
+}
+
+Record* Record::copy () {
+  Record* r = make(layout, size);
+  for (uint16_t f = 0; f < size; ++f)
+    r->fields()[f] = fields()[f];
+  return r;
+}
+
+void Record::free (Record* r) {
+  for (uint16_t f = 0; f < r->size; ++f)
+    r->fields()[f].~Value();
+  ::operator delete(r);
+}
+
+Record* record (Value &v) {
+  return (Record*)v.ptr();
+}
+
+string_view strView (Value &v, string &hold) {
+  if (v.type() == T_Rope) return hold = v.str();
+  return *(string*)v.ptr();
+}
+
+bool strChars (Value &v, string_view &chars, string &hold) {
+  Type t = v.type();
+  if (t == T_Str || t == T_Rope) {
+    chars = strView(v, hold);
+    return true;
+  }
+  if (t != T_Lizt) return false;
+  Lizt* l = v.lizt();
+  veclen skip = 0;
+  if (l->type == P_Take) {
+    skip = ((Lizt::Take*)l->config)->skip;
+    l = ((Lizt::Take*)l->config)->lizt;
+  }
+  if (l->type != P_Str) return false;
+  chars = *(string*)((Value*)l->config)->ptr();
+  chars = chars.substr(min<size_t>(skip, chars.size()), v.lizt()->len);
+  return true;
+}
+
+Value flat (Value &v) {
+  if (v.type() != T_Rope) return v;
+  Rope* r = rope(v);
+  lock_guard<mutex> l(r->buf->lock);
+  if (r->flat.type() != T_Str)
+    r->flat = Value(Data{.ptr=new string(r->buf->data, 0, r->len)}, T_Str);
+  return r->flat;
+}
+
+bool isVec (Type t) {
+  return t == T_Vec || t == T_Pack;
+}
+
+//Returns an item of a T_Vec or T_Pack
+Value vecAt (Value &v, veclen i) {
+  return v.type() == T_Pack ? pack(v)->at(i) : (*vec(v))[i];
+}
+
+//Returns items as a T_Pack if they share a packable type, else a T_Vec
+Value listOf (vector<Value> &items) {
+  Type t = items.size() ? items[0].type() : T_N;
+  bool isPack = Pack::packable(t);
+  for (auto &item : items)
+    if (item.type() != t) {
+      isPack = false;
+      break;
+    }
+  if (isPack) {
+    auto p = new Pack(t, items.size());
+    for (veclen i = 0; i < p->len; ++i)
+      p->set(i, items[i].data());
+    return Value(Data{.ptr=p}, T_Pack);
+  }
+  auto list = immer::flex_vector_transient<Value>();
+  for (auto &item : items)
+    list.push_back(item);
+  return Value(Data{.ptr=new immer::flex_vector<Value>(list.persistent())}, T_Vec);
+}
+
+Value boxed (Value &v) {
+  if (v.type() != T_Pack) return v;
+  auto list = immer::flex_vector_transient<Value>();
+  for (veclen i = 0, iLen = pack(v)->len; i < iLen; ++i)
+    list.push_back(pack(v)->at(i));
+  return Value(Data{.ptr=new immer::flex_vector<Value>(list.persistent())}, T_Vec);
+}
+
+
+HashMap* hashMap (Value &v) {
+  return (HashMap*)v.ptr();
+}
+
+HashSet* hashSet (Value &v) {
+  return (HashSet*)v.ptr();
+}
+
+Value entries (Value &v) {
+  auto items = vector<Value>();
+  if (v.type() == T_Set)
+    for (auto &item : *hashSet(v))
+      items.push_back(item);
+  if (v.type() == T_Map)
+    for (auto &[key, val] : *hashMap(v)) {
+      auto pair = vector<Value>{key, val};
+      items.push_back(listOf(pair));
+    }
+  if (v.type() == T_SMap || v.type() == T_SSet)
+    sorted(v)->each([&](const Value &key, const Value &val) {
+      if (v.type() == T_SSet) items.push_back(key);
+      else {
+        auto pair = vector<Value>{key, val};
+        items.push_back(listOf(pair));
+      }
+    });
+  return listOf(items);
+}
+
+size_t ValueHash::operator() (const Value &c) const {
+  Value &v = const_cast<Value&>(c);
+  switch (v.type()) {
+    case T_Str: return hash<string>{}(*(string*)v.ptr());
+    case T_Rope: return hash<string>{}(v.str());
+    case T_Vec: case T_Pack: {
+      if (size_t h = v.cachedHash()) return h;
+      //Lizts aren't hashed as they compare, so neither is a list of them
+      bool isKept = true;
+      size_t h = 0x9E3779B9;
+      for (veclen i = 0, iLen = Lizt::length(v); i < iLen; ++i) {
+        Value item = vecAt(v, i);
+        h = (h ^ (*this)(item)) * 0x100000001B3;
+        isKept = isKept && item.type() != T_Lizt && (!isVec(item.type()) || item.cachedHash());
+      }
+      if (isKept) v.cacheHash(h);
+      return h;
+    }
+    //Independent of order
+    case T_Set: {
+      size_t h = hashSet(v)->size();
+      for (auto &item : *hashSet(v))
+        h += (*this)(item);
+      return h;
+    }
+    case T_Map: {
+      size_t h = hashMap(v)->size();
+      for (auto &[key, val] : *hashMap(v))
+        h += (*this)(key) * 31 + (*this)(val);
+      return h;
+    }
+    case T_Rec: {
+      size_t h = record(v)->layout;
+      for (uint16_t f = 0; f < record(v)->size; ++f)
+        h = (h ^ (*this)(record(v)->fields()[f])) * 0x100000001B3;
+      return h;
+    }
+    case T_SMap: case T_SSet: {
+      size_t h = sorted(v)->size();
+      sorted(v)->each([&](const Value &key, const Value &val) {
+        h = (h ^ ((*this)(key) * 31 + (*this)(val))) * 0x100000001B3;
+      });
+      return h;
+    }
+  }
+  return hash<uint32_t>{}(v.u32());
+}
+
+int knownAlike (Value &v0, Value &v1) {
+  Type type0 = v0.type(), type1 = v1.type();
+  //Lizts aren't, as an infinite Lizt is not alike to itself
+  if (type0 == type1 && v0.ptr() == v1.ptr()
+   && (type0 == T_Str || type0 == T_Vec || type0 >= T_Pack))
+    return 1;
+  if (!isVec(type0) || !isVec(type1)) return -1;
+  size_t h0 = v0.cachedHash(), h1 = v1.cachedHash();
+  if (h0 && h1 && h0 != h1) return 0;
+  if (type0 != T_Pack || type1 != T_Pack) return -1;
+  Pack *p0 = pack(v0), *p1 = pack(v1);
+  if (p0->len != p1->len) return 0;
+  if (p0->type != p1->type) return -1;
+  return !memcmp(p0->data, p1->data, p0->bytes(p0->len));
+}
+
+bool ValueAlike::operator() (const Value &c0, const Value &c1) const {
+  Value &v0 = const_cast<Value&>(c0), &v1 = const_cast<Value&>(c1);
+  if (int known = knownAlike(v0, v1); known >= 0)
+    return known;
+  Type type0 = v0.type(), type1 = v1.type();
+  if ((type0 == T_D32 || type1 == T_D32) && type0 != type1)
+    return false;
+  bool isStr0 = type0 == T_Str || type0 == T_Rope, isStr1 = type1 == T_Str || type1 == T_Rope;
+  if (isStr0 || isStr1) {
+    string hold0, hold1;
+    return isStr0 && isStr1 && strView(v0, hold0) == strView(v1, hold1);
+  }
+  if (isVec(type0) && isVec(type1)) {
+    veclen len = Lizt::length(v0);
+    if (len != Lizt::length(v1)) return false;
+    for (veclen i = 0; i < len; ++i)
+      if (!(*this)(vecAt(v0, i), vecAt(v1, i)))
+        return false;
+    return true;
+  }
+  if (type0 == T_Set && type1 == T_Set) {
+    if (hashSet(v0)->size() != hashSet(v1)->size()) return false;
+    for (auto &item : *hashSet(v0))
+      if (!hashSet(v1)->count(item))
+        return false;
+    return true;
+  }
+  if (type0 == T_Map && type1 == T_Map) {
+    if (hashMap(v0)->size() != hashMap(v1)->size()) return false;
+    for (auto &[key, val] : *hashMap(v0)) {
+      auto found = hashMap(v1)->find(key);
+      if (!found || !(*this)(val, *found))
+        return false;
+    }
+    return true;
+  }
+  if ((type0 == T_SMap || type0 == T_SSet) && type0 == type1) {
+    Sorted* s0 = sorted(v0), *s1 = sorted(v1);
+    if (s0->size() != s1->size()) return false;
+    for (veclen i = 0, iLen = s0->size(); i < iLen; ++i) {
+      auto [key0, val0] = s0->at(i);
+      auto [key1, val1] = s1->at(i);
+      if (!(*this)(key0, key1) || !(*this)(val0, val1))
+        return false;
+    }
+    return true;
+  }
+  if (type0 == T_Rec && type1 == T_Rec) {
+    Record* r0 = record(v0), *r1 = record(v1);
+    if (r0->layout != r1->layout) return false;
+    for (uint16_t f = 0; f < r0->size; ++f)
+      if (!(*this)(r0->fields()[f], r1->fields()[f]))
+        return false;
+    return true;
+  }
+  if (type0 == T_Lizt || type1 == T_Lizt)
+    return type0 == type1 && v0.ptr() == v1.ptr();
+  return v0.u32() == v1.u32();
+}
+
+
+Pack::Pack (Type t, veclen n) : type(t), len(n) {
+  data = malloc(bytes(n) + 1);
+  if (t == T_Bool) memset(data, 0, bytes(n));
+}
+
+Pack::~Pack () {
+  free(data);
+}
+
+Value Pack::at (veclen i) {
+  Data d = Data{};
+  if (type == T_Bool) d.tru = words()[i / 64] >> (i % 64) & 1;
+  else if (itemSize() == 1) d.u08 = ((uint8_t*)data)[i];
+  else d.u32 = ((uint32_t*)data)[i];
+  return Value(d, type);
+}
+
+void Pack::set (veclen i, Data d) {
+  hash = 0;
+  if (type == T_Bool) {
+    uint64_t bit = 1ull << (i % 64);
+    if (d.tru) words()[i / 64] |= bit;
+    else words()[i / 64] &= ~bit;
+  }
+  else if (itemSize() == 1) ((uint8_t*)data)[i] = d.u08;
+  else ((uint32_t*)data)[i] = d.u32;
+}
+
+void Pack::resize (veclen n) {
+  hash = 0;
+  veclen was = bytes(len);
+  data = realloc(data, bytes(n) + 1);
+  if (type == T_Bool) {
+    if (bytes(n) > was)
+      memset((uint8_t*)data + was, 0, bytes(n) - was);
+    else if (n % 64)
+      words()[n / 64] &= (1ull << n % 64) - 1;
+  }
+  len = n;
+}
+
+Pack* Pack::slice (veclen from, veclen to) {
+  auto p = new Pack(type, to - from);
+  if (type != T_Bool) {
+    memcpy(p->data, (uint8_t*)data + from * itemSize(), p->len * itemSize());
+    return p;
+  }
+  //Shift words down, taking the low bits of each next word
+  uint64_t* src = words() + from / 64;
+  uint8_t shift = from % 64;
+  veclen srcWords = bytes(len) / 8 - from / 64;
+  for (veclen w = 0, wLen = p->bytes(p->len) / 8; w < wLen; ++w) {
+    uint64_t word = src[w] >> shift;
+    if (shift && w + 1 < srcWords) word |= src[w + 1] << (64 - shift);
+    p->words()[w] = word;
+  }
+  if (p->len % 64)
+    p->words()[p->len / 64] &= (1ull << p->len % 64) - 1;
+  return p;
+}
+
+void Pack::place (veclen at, Pack* src) {
+  if (type != T_Bool) {
+    memcpy((uint8_t*)data + at * itemSize(), src->data, src->len * itemSize());
+    return;
+  }
+  uint64_t* dst = words() + at / 64;
+  uint8_t shift = at % 64;
+  veclen dstWords = bytes(len) / 8 - at / 64;
+  for (veclen w = 0, wLen = src->bytes(src->len) / 8; w < wLen; ++w) {
+    dst[w] |= src->words()[w] << shift;
+    if (shift && w + 1 < dstWords) dst[w + 1] |= src->words()[w] >> (64 - shift);
+  }
+}
+
+bool Pack::packable (Type t) {
+  return t == T_U08 || t == T_S32 || t == T_U32 || t == T_D32 || t == T_Bool;
 }
 
 
@@ -64,9 +569,7 @@ Cell::~Cell () {
 }
 
 bool Cell::checkMemLeak () {
-  refnum ref = 0;
-  while (ref < NUM_OBJ && !refs[ref++]);
-  return ref != NUM_OBJ;
+  return heap->hasLeak();
 }
 
 
@@ -75,96 +578,277 @@ bool Cell::checkMemLeak () {
 
 /// C'tor, D'tor, Copies
 
-Lizt::Lizt (LiztT _type, veclen _len, void* _state)
-  : type(_type), len(_len), config(_state) {
-  refs[ref = newRef()] = 1;
+Lizt::Lizt (LiztT _type, veclen _len, void* _state, bool _inf)
+  : type(_type), len(_inf ? 0 : _len), inf(_inf), config(_state), tag(liztTag), home(heap->id) {
+  ref = heap->newRef();
 }
 Lizt::Lizt (const Lizt& obj) {
   type = obj.type;
   len = obj.len;
+  inf = obj.inf;
   config = obj.config;
-  ++refs[ref = obj.ref];
+  tag = obj.tag;
+  home = obj.home;
+  Heap::at(home)->retain(ref = obj.ref);
 }
 Lizt& Lizt::operator= (const Lizt& obj) {
   type = obj.type;
   len = obj.len;
+  inf = obj.inf;
   config = obj.config;
-  ++refs[ref = obj.ref];
+  tag = obj.tag;
+  home = obj.home;
+  Heap::at(home)->retain(ref = obj.ref);
   return *this;
 }
 
 Lizt::~Lizt () {
-  if (!refs[ref] || --refs[ref]) return;
+  if (!Heap::at(home)->release(ref)) return;
   switch (type) {
-    case P_Vec:   delete (vector<Value>*)config; break;
+    case P_Vec: case P_Str:
+                  delete (Value*)config;         break;
     case P_Take:  delete (Take*)config;          break;
     case P_Range: delete (Range*)config;         break;
     case P_Cycle: delete (vector<Value>*)config; break;
     case P_Emit:  delete (Value*)config;         break; 
     case P_Map:   delete (Map*)config;           break;
+    case P_Iterate: case P_Unfold:
+                  delete (Gen*)config;           break;
+    case P_Memo:  delete (Memo*)config;          break;
+    case P_Where: delete (Where*)config;         break;
+    case P_Span:  delete (Span*)config;          break;
+    case P_Reverse: delete (Lizt*)config;        break;
+    case P_Window:  delete (Window*)config;      break;
   }
-  if (ref < leftmostRef)
-    leftmostRef = ref;
 }
 
 Lizt::Map::~Map () {
+  call.val.kill(); //Ensure head is not destroyed with call
   delete head;
   for (auto s : sources)
     delete s;
 }
 
+Lizt::Gen::~Gen () {
+  delete head;
+}
+
+Lizt::Memo::~Memo () {
+  delete lizt;
+  for (auto c : chunks)
+    delete c;
+}
+
+Lizt::Where::~Where () {
+  delete scan;
+  delete head;
+  delete lizt;
+}
+
 Lizt::Take::~Take () {
   delete lizt;
 }
 
+Lizt::Window::~Window () {
+  delete lizt;
+}
+
 /// Factories
 
 //Accepts a Value of any type and converts it to a Lizt.
-//  If the Value is not a T_Vec or T_Lizt it returns a P_Emit.
+//  A T_Vec or T_Pack is shared rather than copied,
+//  a T_Map or T_Set is enumerated as a T_Vec of its entries,
+//  a T_SMap or T_SSet as a P_Span of its entries in order,
+//  and a T_Str as a P_Str of its characters, sharing its buffer.
+//  Any other Value returns a P_Emit.
 Lizt* Lizt::list (Value v) {
   if (v.type() == T_Lizt)
     return new Lizt(*v.lizt());
-  if (v.type() == T_Vec) {
-    auto iVect = vec(v);
-    auto mVect = new vector<Value>();
-    for (Value val : *iVect)
-      mVect->push_back(val);
-    return new Lizt(P_Vec, mVect->size(), mVect);
-  }
-  return emit(v, -1);
+  if (isVec(v.type()))
+    return new Lizt(P_Vec, length(v), new Value(v));
+  if (v.type() == T_Str)
+    return new Lizt(P_Str, length(v), new Value(v));
+  if (v.type() == T_Map || v.type() == T_Set)
+    return new Lizt(P_Vec, length(v), new Value(entries(v)));
+  if (v.type() == T_SMap || v.type() == T_SSet)
+    return span(v, 0, length(v));
+  return emit(v, 0, true);
 }
 
+//Fuses a skip/take into its source where there is a closed form:
+//  take of take, take of range/emit/cycle, and take of map by pushing
+//  the take into each source. Otherwise returns a P_Take.
+//  A negative skip is none
 Lizt* Lizt::take (Take* take) {
-  veclen len = take->take != -1 ? take->take : take->lizt->len;
-  return new Lizt(P_Take, len, take);
+  Lizt* src = take->lizt;
+  veclen skip = take->skip = max(take->skip, (veclen)0), len = take->take;
+  bool inf = src->isInf() && len < 0;
+  if (!src->isInf()) {
+    veclen left = max(src->len - skip, (veclen)0);
+    len = len < 0 ? left : min(len, left);
+  }
+  Lizt* fused = nullptr;
+  switch (src->type) {
+    case P_Take: {
+      auto t = (Take*)src->config;
+      fused = Lizt::take(new Take{new Lizt(*t->lizt), t->skip + skip, len});
+      break;
+    }
+    case P_Range: {
+      auto r = (Range*)src->config;
+      fused = range(Range{r->from + skip * r->step, r->step}, len, inf);
+      break;
+    }
+    case P_Emit:
+      fused = emit(*(Value*)src->config, len, inf);
+      break;
+    case P_Cycle: {
+      auto c = *(vector<Value>*)src->config;
+      //An empty cycle has no items to take
+      if (c.empty()) {
+        fused = emit(Value(), 0);
+        break;
+      }
+      rotate(c.begin(), c.begin() + (skip % c.size()), c.end());
+      fused = cycle(c);
+      if (!inf)
+        fused = new Lizt(P_Take, len, new Take{fused, 0, len});
+      break;
+    }
+    case P_Span: {
+      auto s = (Span*)src->config;
+      fused = span(s->coll, s->from + skip, len);
+      break;
+    }
+    case P_Reverse: {
+      //Take from the other end of the source
+      Lizt* rev = (Lizt*)src->config;
+      fused = reverse(Lizt::take(new Take{new Lizt(*rev), src->len - skip - len, len}));
+      break;
+    }
+    case P_Map: {
+      auto m = (Map*)src->config;
+      auto sources = vector<Lizt*>();
+      for (auto s : m->sources)
+        sources.push_back(Lizt::take(new Take{new Lizt(*s), skip, len}));
+      fused = map(new Cell{m->head->val}, sources);
+      break;
+    }
+  }
+  if (fused) {
+    delete take;
+    return fused;
+  }
+  take->take = len;
+  return new Lizt(P_Take, len, take, inf);
+}
+
+Lizt* Lizt::span (Value coll, veclen from, veclen len) {
+  return new Lizt(P_Span, len, new Span{coll, from});
+}
+
+//Returns a finite Lizt's items in reverse, or its source if a reverse
+Lizt* Lizt::reverse (Lizt* lizt) {
+  if (lizt->type == P_Reverse) {
+    Lizt* src = new Lizt(*(Lizt*)lizt->config);
+    delete lizt;
+    return src;
+  }
+  return new Lizt(P_Reverse, lizt->len, lizt);
+}
+
+//Returns take Lizts of size items of a source, each step items apart
+Lizt* Lizt::window (Lizt* lizt, veclen size, veclen step) {
+  veclen len = lizt->len < size ? 0 : (lizt->len - size) / step + 1;
+  return new Lizt(P_Window, len, new Window{lizt, size, step}, lizt->isInf());
 }
 
-Lizt* Lizt::range (Range range) {
-  veclen len = range.to > 0 ? range.to - range.from : range.from - range.to;
-  if (len) len /= abs(range.step);
-  if (!len) len = -1;
-  return new Lizt(P_Range, len, new Range(range));
+Lizt* Lizt::range (Range range, veclen len, bool inf) {
+  return new Lizt(P_Range, len, new Range(range), inf);
 }
 
 Lizt* Lizt::cycle (vector<Value> v) {
-  return new Lizt(P_Cycle, -1, new vector<Value>{v});
+  return new Lizt(P_Cycle, 0, new vector<Value>{v}, true);
 }
 
-Lizt* Lizt::emit (Value v, veclen len) {
-  return new Lizt(P_Emit, len, new Value(v));
+Lizt* Lizt::emit (Value v, veclen len, bool inf) {
+  return new Lizt(P_Emit, len, new Value(v), inf);
+}
+
+//Fuses maps over maps into one stage, so each item is fetched once per source
+//  through one index rather than one layer at a time.
+//  e.g. (map f (map g v w) x) => (map #(f (g %0 %1) %2) v w x)
+static Cell* fuseMaps (Cell* head, vector<Lizt*> &sources) {
+  Value f = head->val;
+  if (f.type() == T_Op && f.op() <= O_Delay) return head; //Short-circuited
+  size_t numParas = 0;
+  bool anyMap = false;
+  for (auto s : sources)
+    if (s->type == P_Map) {
+      anyMap = true;
+      numParas += ((Lizt::Map*)s->config)->sources.size();
+    } else ++numParas;
+  if (!anyMap || numParas > UINT8_MAX) return head;
+  auto fused = vector<Lizt*>();
+  Cell* form = new Cell{f};
+  Cell* arg = form;
+  for (auto s : sources) {
+    if (s->type != P_Map) {
+      arg = arg->next = new Cell{Value(Data{.u08=uint8_t(fused.size())}, T_Para)};
+      fused.push_back(s);
+      continue;
+    }
+    auto m = (Lizt::Map*)s->config;
+    Cell* call = new Cell{m->head->val};
+    arg = arg->next = new Cell{Value(Data{.cell=call}, T_Cell)};
+    for (auto ms : m->sources) {
+      call = call->next = new Cell{Value(Data{.u08=uint8_t(fused.size())}, T_Para)};
+      fused.push_back(new Lizt(*ms));
+    }
+    delete s;
+  }
+  delete head;
+  sources = fused;
+  return new Cell{Value(Data{.cell=form}, T_Lamb)};
 }
 
 Lizt* Lizt::map (Cell* head, vector<Lizt*> sources) {
-  //Check if all are infinite
-  veclen smallest, maximum;
-  smallest = maximum = numeric_limits<veclen>::max();
+  head = fuseMaps(head, sources);
+  //Allocate the argument Cells once, to be reused per item
+  Cell* arg = head;
+  for (argnum v = 0, vLen = sources.size(); v < vLen; ++v)
+    arg = arg->next = new Cell;
+  //As long as the shortest finite source, or infinite if all are
+  veclen smallest = numeric_limits<veclen>::max();
+  bool inf = true;
   for (argnum v = 0, vLen = sources.size(); v < vLen; ++v)
-    if (!sources[v]->isInf())
-      if (sources[v]->len < smallest)
-        smallest = sources[v]->len;
-  if (smallest == maximum)
-    smallest = -1;
-  return new Lizt(P_Map, smallest, new Map{sources, head});
+    if (!sources[v]->isInf()) {
+      inf = false;
+      smallest = min(smallest, sources[v]->len);
+    }
+  auto m = new Map{sources, head};
+  m->call.val = Value(Data{.cell=head}, T_Cell);
+  return new Lizt(P_Map, smallest, m, inf);
+}
+
+//Returns an infinite generator of type P_Iterate or P_Unfold
+Lizt* Lizt::gen (LiztT type, Cell* head, Value seed) {
+  head->next = new Cell;
+  return new Lizt(type, 0, new Gen{head, seed}, true);
+}
+
+//Returns a Lizt which realizes and retains its source's items in chunks,
+//  shared by all copies of it
+Lizt* Lizt::memo (Lizt* lizt) {
+  if (lizt->type == P_Memo) return lizt;
+  return new Lizt(P_Memo, lizt->len, new Memo{lizt}, lizt->isInf());
+}
+
+//Returns an infinite Lizt of the items of an infinite source
+//  which satisfy the head Cell's predicate, found on demand
+Lizt* Lizt::where (Cell* head, Lizt* lizt) {
+  head->next = new Cell;
+  return new Lizt(P_Where, 0, new Where{lizt, head, nullptr}, true);
 }
 
 /// Methods and non-factory statics
@@ -172,11 +856,23 @@ Lizt* Lizt::map (Cell* head, vector<Lizt*> sources) {
 veclen Lizt::length (Value &v) {
   if (v.type() == T_Vec)
     return vec(v)->size();
+  if (v.type() == T_Pack)
+    return pack(v)->len;
   if (v.type() == T_Lizt)
-    return v.lizt()->len;
+    return v.lizt()->isInf() ? -1 : v.lizt()->len;
+  if (v.type() == T_Str)
+    return ((string*)v.ptr())->size();
+  if (v.type() == T_Rope)
+    return rope(v)->len;
+  if (v.type() == T_Map)
+    return hashMap(v)->size();
+  if (v.type() == T_Set)
+    return hashSet(v)->size();
+  if (v.type() == T_SMap || v.type() == T_SSet)
+    return sorted(v)->size();
   return 0;
 }
 
 bool Lizt::isInf () {
-  return len == -1;
+  return inf;
 }
\ No newline at end of file
@@ -1,16 +1,52 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <queue>
-#include <immer/vector.hpp>
-#include <immer/vector_transient.hpp>
+#include <immer/flex_vector.hpp>
+#include <immer/flex_vector_transient.hpp>
+#include <immer/map.hpp>
+#include <immer/map_transient.hpp>
+#include <immer/set.hpp>
+#include <immer/set_transient.hpp>
 #include "Enums.hpp"
 using namespace std;
 
 struct Cell;
 class Lizt;
+struct Cursor;
+struct Future;
+struct Thunk;
+void deleteFuture (Future*);
+void deleteThunk  (Thunk*);
+
+//ARC reference counts of the Values of one EVM or isolate,
+//  referred to by the heap id in each Value
+struct Heap {
+  uint32_t refs[NUM_OBJ] = {0}; //Counts by refnum
+  size_t hashes[NUM_OBJ] = {0}; //Item hashes of T_Vecs by refnum, once computed
+  refnum leftmostRef = 1;
+  uint8_t id = 0;
+  bool full = false; //No id was free, so it must not be used
+  atomic<uint32_t> shared {0};  //Nonzero while Values are shared between threads
+  atomic<uint32_t> futures {0}; //Futures queued or running on the pool
+  Heap ();
+  ~Heap ();
+  refnum newRef  ();
+  void   retain  (refnum);
+  bool   release (refnum);
+  bool   hasLeak ();
+  static Heap* at (uint8_t);
+};
+
+//Heap of the Values made by this thread
+extern thread_local Heap* heap;
+//Tag given to Lizts made by this thread, changed per parallel task
+extern thread_local uint32_t liztTag;
 
 union Data {
   void*    ptr; Cell*    cell;
@@ -25,6 +61,7 @@ union Data {
 class Value {
   void setRef ();
   refnum _ref = 0;
+  uint8_t _heap = 0;
   Data _data = Data{};
   Type _type = T_N;
 
@@ -36,6 +73,10 @@ public:
   ~Value ();
 
   void     kill ();
+  bool     isUnique ();
+  //The hash of a T_Vec or T_Pack's items once computed, otherwise 0
+  size_t   cachedHash ();
+  void     cacheHash  (size_t);
   Data     data () { return _data; }
   Type     type () { return _type; }
   void*    ptr  () { return _data.ptr; }
@@ -45,7 +86,7 @@ public:
   int32_t  s32  () { return _data.s32; }
   float    d32  () { return _data.d32; }
   fid      func () { return _data.fID; }
-  string   str  () { return *(string*)_data.ptr; }
+  string   str  ();
   Cell*    cell () { return (Cell*)_data.ptr; }
   Lizt*    lizt () { return (Lizt*)_data.ptr; }
   //Coercions & information
@@ -76,7 +117,107 @@ public:
   bool     hasSign () { return _type == T_S08 || _type == T_S32 || _type == T_D32; }
 };
 
-immer::vector<Value>* vec (Value&);
+immer::flex_vector<Value>* vec (Value&);
+
+//Contiguous items of one type. Booleans are a bitset of 64-bit words,
+//  with the bits past len kept clear
+struct Pack {
+  Type type; //U08 S32 U32 D32 Bool
+  veclen len;
+  void* data;
+  atomic<size_t> hash {0}; //Of the items if computed, cleared on change
+  Pack (Type, veclen);
+  ~Pack ();
+  uint8_t   itemSize () { return type == T_U08 ? 1 : 4; }
+  veclen    bytes (veclen n) { return type == T_Bool ? (n + 63) / 64 * 8 : n * itemSize(); }
+  uint64_t* words () { return (uint64_t*)data; }
+  Value at  (veclen);
+  void  set (veclen, Data);
+  void  resize (veclen);
+  //Returns a new pack of items [from, to)
+  Pack* slice (veclen from, veclen to);
+  //Copies the items of another pack of the type from an index,
+  //  which for booleans must be clear
+  void  place (veclen at, Pack*);
+  static bool packable (Type);
+};
+
+Pack* pack (Value&);
+
+//A string built by appending to one buffer shared between versions.
+//  An append extends the buffer in place if this version reaches its end,
+//  otherwise copies this version's part of it first, so appending is
+//  amortized O(1) and earlier versions are unchanged
+struct Rope {
+  struct Buf {
+    string data;
+    mutex  lock;
+  };
+  shared_ptr<Buf> buf;
+  size_t len;
+  Value  flat; //As a T_Str once first read as one, guarded by buf's lock
+  Rope*  append (const string&) const;
+  string str () const;
+  char   at (size_t) const;
+};
+
+Rope* rope (Value&);
+
+//The field names of a record type declared by defrecord. Layouts are
+//  shared by every EVM and never freed, so are read without a lock
+struct Layout {
+  string name;
+  vector<string> fields;
+  //Returns the id of a name's layout, added if new or its fields differ,
+  //  or -1 if there are MAX_LAYOUTS
+  static int32_t  add (const string&, vector<string>);
+  //Returns the id of the latest layout of a name, or -1
+  static int32_t  find (const string&);
+  static Layout*  at (uint16_t);
+  static uint16_t count ();
+};
+
+//A record type instance, its fields stored after it in one allocation
+struct alignas(Value) Record {
+  uint16_t layout;
+  uint16_t size;
+  Value* fields () { return (Value*)(this + 1); }
+  static Record* make (uint16_t layout, uint16_t size);
+  Record* copy ();
+  static void free (Record*);
+};
+
+Record* record (Value&);
+//Returns the characters of a T_Str in place, or of a T_Rope copied to hold
+string_view strView (Value&, string &hold);
+//Gets the characters of a string, or of a Lizt of a string's characters,
+//  returning false for any other Value
+bool  strChars (Value&, string_view&, string &hold);
+//Returns a T_Rope as a T_Str, made once per rope, or any other Value as it is
+Value flat (Value&);
+bool  isVec  (Type);
+Value vecAt  (Value&, veclen);
+Value listOf (vector<Value>&);
+//Returns a T_Vec of the items of a T_Vec or T_Pack
+Value boxed  (Value&);
+
+//Hashing and equality of map keys and set items, consistent with
+//  areAlike for realized Values
+struct ValueHash  { size_t operator() (const Value&) const; };
+struct ValueAlike { bool   operator() (const Value&, const Value&) const; };
+typedef immer::map<Value, Value, ValueHash, ValueAlike> HashMap;
+typedef immer::set<Value, ValueHash, ValueAlike> HashSet;
+
+//Returns 1 if Values are alike, 0 if not, or -1 if unknown without
+//  comparing items: the same object, packs by their bytes, and lists by
+//  hashes already computed
+int knownAlike (Value&, Value&);
+
+HashMap* hashMap (Value&);
+HashSet* hashSet (Value&);
+//Returns the items of a T_Set or T_SSet, or [key value] pairs of a
+//  T_Map or T_SMap, as a list
+Value entries (Value&);
 
 struct Cell {
   Value val;
@@ -89,35 +230,68 @@ struct Cell {
 
 enum LiztT : uint8_t {
   P_Vec, P_Take, P_Range, P_Cycle, P_Emit,
-  P_Map
+  P_Map, P_Iterate, P_Unfold, P_Memo, P_Where, P_Span,
+  P_Reverse, P_Window, P_Str
 };
 
 class Lizt {
 public:
   struct Range {
-    const int32_t from = 0; //
-    const int32_t to   = 0; // Equal for infinite
-    const int32_t step = 0;
+    const int64_t from = 0;
+    const int64_t step = 0;
   };
   struct Take {
-    Lizt*   lizt;
-    int32_t skip;
-    int32_t take; //Negative for infinite
+    Lizt*  lizt;
+    veclen skip;
+    veclen take; //Negative for all remaining
     ~Take ();
   };
   struct Map {
     vector<Lizt*> sources;
-    Cell* head;
+    Cell* head; //Followed by one argument Cell per source
+    Cell call;  //The form applying head, made once rather than per item
     ~Map ();
   };
+  struct Gen {
+    Cell* head; //Followed by one argument Cell
+    Value seed;
+    ~Gen ();
+  };
+  struct Memo {
+    Lizt* lizt;
+    vector<vector<Value>*> chunks; //MEMO_CHUNK items each, or nullptr
+    ~Memo ();
+  };
+  struct Span {
+    Value coll; //T_SMap or T_SSet
+    veclen from;
+  };
+  struct Window {
+    Lizt*  lizt;
+    veclen size;
+    veclen step;
+    ~Window ();
+  };
+  struct Where {
+    Lizt* lizt;
+    Cell* head;            //Followed by an argument Cell
+    Cursor* scan;          //Source position of the next test
+    vector<Value> matches; //Found so far
+    ~Where ();
+  };
 
   refnum ref;
   LiztT type;
-  veclen len;
+  veclen len; //Of a finite Lizt
+  bool   inf;
   //Config types:
-  //  P_Vec:vector<Value>* P_Cycle:vector<Value>* P_Range:Range*
-  //  P_Map:Map* P_Take:Take* P_Repeat:Value
+  //  P_Vec:Value* (T_Vec/T_Pack) P_Cycle:vector<Value>* P_Range:Range*
+  //  P_Map:Map* P_Take:Take* P_Emit:Value* P_Iterate/P_Unfold:Gen*
+  //  P_Memo:Memo* P_Where:Where* P_Span:Span*
+  //  P_Reverse:Lizt* P_Window:Window* P_Str:Value* (T_Str)
   void* config;
+  uint32_t tag; //liztTag of the maker
+  uint8_t home; //Heap of ref
 
   Lizt (const Lizt&);
   Lizt& operator= (const Lizt&);
@@ -125,14 +299,31 @@ public:
   ~Lizt ();
   static Lizt* list  (Value);
   static Lizt* take  (Take*);
-  static Lizt* range (Range);
+  static Lizt* range (Range, veclen, bool inf = false);
   static Lizt* cycle (vector<Value>);
-  static Lizt* emit  (Value, veclen);
+  static Lizt* emit  (Value, veclen, bool inf = false);
   static Lizt* map   (Cell*, vector<Lizt*>);
+  static Lizt* gen   (LiztT, Cell*, Value);
+  static Lizt* memo  (Lizt*);
+  static Lizt* where (Cell*, Lizt*);
+  static Lizt* span  (Value, veclen, veclen);
+  static Lizt* reverse (Lizt*);
+  static Lizt* window  (Lizt*, veclen, veclen);
+  //Returns the number of items of a collection or string,
+  //  -1 for an infinite Lizt, or 0
   static veclen length (Value&); 
   bool isInf ();
 
 private:
 
-  Lizt (LiztT, veclen, void*);
+  Lizt (LiztT, veclen, void*, bool inf = false);
+};
+
+//Per-traversal state for sequential Lizt access,
+//  used where an item depends on the previous one
+struct Cursor {
+  Lizt* lizt;
+  veclen at = 0;
+  Value state;            //P_Iterate/P_Unfold: current seed
+  vector<Cursor> sources; //P_Take: one, P_Map: one per source
 };
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "Channel.hpp"
+#include "Sorted.hpp"
+
+//Items of vectors and forms are always copied, as they may be shared
+static Message detach (Value &v, bool canMove) {
+  Message m = Message{v.type(), v.data()};
+  switch (v.type()) {
+    case T_Str:
+      if (canMove && v.isUnique()) v.kill();
+      else m.data.ptr = new string(v.str());
+      break;
+    case T_Rope:
+      m = Message{T_Str, Data{.ptr=new string(v.str())}};
+      break;
+    case T_Pack:
+      if (canMove && v.isUnique()) v.kill();
+      else {
+        Pack* from = pack(v);
+        auto p = new Pack(from->type, from->len);
+        memcpy(p->data, from->data, p->bytes(p->len));
+        m.data.ptr = p;
+      }
+      break;
+    case T_Vec:
+      for (auto item : *vec(v))
+        m.items.push_back(detach(item, false));
+      break;
+    case T_Cell: case T_Lamb:
+      for (Cell* c = v.cell(); c; c = c->next)
+        m.items.push_back(detach(c->val, false));
+      break;
+    case T_Map:
+      for (auto &[key, val] : *hashMap(v)) {
+        m.items.push_back(detach(const_cast<Value&>(key), false));
+        m.items.push_back(detach(const_cast<Value&>(val), false));
+      }
+      break;
+    case T_Rec:
+      m.data = Data{.u32=record(v)->layout};
+      for (uint16_t f = 0; f < record(v)->size; ++f)
+        m.items.push_back(detach(record(v)->fields()[f], false));
+      break;
+    case T_Set:
+      for (auto &item : *hashSet(v))
+        m.items.push_back(detach(const_cast<Value&>(item), false));
+      break;
+    case T_SMap: case T_SSet:
+      sorted(v)->each([&](const Value &key, const Value &val) {
+        m.items.push_back(detach(const_cast<Value&>(key), false));
+        if (v.type() == T_SMap)
+          m.items.push_back(detach(const_cast<Value&>(val), false));
+      });
+      break;
+    //Lazy lists must be realized by the sender
+    case T_Lizt: case T_Future: case T_Thunk:
+      m = Message();
+      break;
+  }
+  return m;
+}
+
+static Value attach (Message &m) {
+  switch (m.type) {
+    case T_Vec: {
+      auto items = vector<Value>();
+      for (auto &item : m.items)
+        items.push_back(attach(item));
+      return listOf(items);
+    }
+    case T_Cell: case T_Lamb: {
+      Cell* head = nullptr, *prev = nullptr;
+      for (auto &item : m.items) {
+        Cell* c = new Cell{attach(item)};
+        (prev ? prev->next : head) = c;
+        prev = c;
+      }
+      return Value(Data{.cell=head}, m.type);
+    }
+    case T_Map: {
+      auto map = HashMap().transient();
+      for (size_t i = 0; i + 1 < m.items.size(); i += 2)
+        map.set(attach(m.items[i]), attach(m.items[i + 1]));
+      return Value(Data{.ptr=new HashMap(map.persistent())}, T_Map);
+    }
+    case T_Rec: {
+      Record* r = Record::make(m.data.u32, m.items.size());
+      for (uint16_t f = 0; f < r->size; ++f)
+        r->fields()[f] = attach(m.items[f]);
+      return Value(Data{.ptr=r}, T_Rec);
+    }
+    case T_Set: {
+      auto set = HashSet().transient();
+      for (auto &item : m.items)
+        set.insert(attach(item));
+      return Value(Data{.ptr=new HashSet(set.persistent())}, T_Set);
+    }
+    case T_SMap: case T_SSet: {
+      bool isMap = m.type == T_SMap;
+      auto keys = vector<Value>(), vals = vector<Value>();
+      for (size_t i = 0; i < m.items.size(); i += 1 + isMap) {
+        keys.push_back(attach(m.items[i]));
+        if (isMap) vals.push_back(attach(m.items[i + 1]));
+      }
+      return Value(Data{.ptr=new Sorted(isMap, keys, vals)}, m.type);
+    }
+  }
+  return Value(m.data, m.type);
+}
+
+//Frees the objects of a Message which was never attached
+static void discard (Message &m) {
+  if (m.type == T_Str) delete (string*)m.data.ptr;
+  if (m.type == T_Pack) delete (Pack*)m.data.ptr;
+  for (auto &item : m.items)
+    discard(item);
+}
+
+
+Channel::~Channel () {
+  for (auto &m : queue)
+    discard(m);
+}
+
+void Channel::send (Value &v) {
+  Message m = detach(v, true);
+  {
+    lock_guard<mutex> l(lock);
+    queue.push_back(move(m));
+  }
+  ready.notify_one();
+}
+
+bool Channel::recv (Value &v) {
+  Message m;
+  {
+    unique_lock<mutex> l(lock);
+    ready.wait(l, [&] { return queue.size() || closed; });
+    if (queue.empty()) return false;
+    m = move(queue.front());
+    queue.pop_front();
+  }
+  v = attach(m);
+  return true;
+}
+
+void Channel::close () {
+  {
+    lock_guard<mutex> l(lock);
+    closed = true;
+  }
+  ready.notify_all();
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "Cell.hpp"
+using namespace std;
+
+//A Value detached from any heap, to be passed between isolates.
+//  Strings and packs are owned; vectors, forms, sets and maps hold
+//  their items, maps as alternating keys and values, in order if sorted,
+//  and records hold their fields with the layout id as data
+struct Message {
+  Type type = T_N;
+  Data data = Data{};
+  vector<Message> items;
+};
+
+//A queue of Values from one isolate to another
+class Channel {
+  mutex lock;
+  condition_variable ready;
+  deque<Message> queue;
+  bool closed = false;
+
+public:
+  ~Channel ();
+  //Detaches a copy of the Value, moving rather than copying
+  //  its string or pack if it holds the only reference
+  void send  (Value&);
+  //Waits for a Value and attaches it to this thread's heap.
+  //  Returns false once closed and empty
+  bool recv  (Value&);
+  void close ();
+};
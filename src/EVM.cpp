@@ -1,7 +1,14 @@
 #include "EVM.hpp"
+#include "Kernels.hpp"
+#include "Pool.hpp"
+#include "Sort.hpp"
+#include "Sorted.hpp"
+#include <immer/algorithm.hpp>
 #include <cstdint>
 #include <cstring>
 #include <cmath>
+#include <mutex>
+#include <thread>
 
 argnum numArgs (Cell* a) {
   if (!a) return 0;
@@ -10,11 +17,56 @@ argnum numArgs (Cell* a) {
   return num;
 }
 
+//Returns a length or index argument, reading a U32 unsigned
+static veclen toLen (Value v) {
+  return v.type() == T_U32 ? (veclen)v.u32() : v.s32c();
+}
+
+//Returns a length or index as an S32, or a U32 past the S32 range
+static Value lenOf (veclen n) {
+  if (n > INT32_MAX) return Value(Data{.u32=(uint32_t)n}, T_U32);
+  return Value(Data{.s32=(int32_t)n}, T_S32);
+}
+
 bool isCallType (Cell* a) {
   Type t = a->val.type();
   return t == T_Lamb || t == T_Op || t == T_Func;
 }
 
+//Returns the bits of a vector, or a take of one, of homogeneous
+//  U08/S32/U32/D32 items for the vectorized kernels.
+//  32-bit T_Packs are used in place, otherwise items are copied to buf
+const uint32_t* gatherNums (Lizt* l, Type &t, vector<uint32_t> &buf) {
+  Lizt* src = l;
+  veclen skip = 0;
+  if (l->type == P_Take) {
+    auto take = (Lizt::Take*)l->config;
+    src = take->lizt;
+    skip = take->skip;
+  }
+  if (src->type != P_Vec || l->isInf() || !l->len) return nullptr;
+  Value v = *(Value*)src->config;
+  t = vecAt(v, skip).type();
+  if (t != T_U08 && t != T_S32 && t != T_U32 && t != T_D32) return nullptr;
+  if (v.type() == T_Pack && t != T_U08)
+    return (uint32_t*)pack(v)->data + skip;
+  buf.clear();
+  buf.reserve(l->len);
+  for (veclen i = skip, iLen = skip + l->len; i < iLen; ++i) {
+    Value item = vecAt(v, i);
+    if (item.type() != t) return nullptr;
+    buf.push_back(t == T_U08 ? item.u08() : item.u32());
+  }
+  return buf.data();
+}
+
+Value numsToPack (const uint32_t* nums, veclen len, Type t) {
+  auto p = new Pack(t, len);
+  for (veclen i = 0; i < len; ++i)
+    p->set(i, Data{.u32=nums[i]});
+  return Value(Data{.ptr=p}, T_Pack);
+}
+
 template <class T>
 T hcpy (T* ptr) {
   T cpy = *ptr;
@@ -60,19 +112,51 @@ void FuncList::add (fid id, vector<Cell*> cells) {
 
 void EVM::addFunc (fid id, vector<Cell*> cells) {
   removeFunc(id);
-  funcs.add(id, cells);
+  funcs->add(id, cells);
 }
 
 void EVM::removeFunc (fid id) {
-  funcs.remove(id);
+  funcs->remove(id);
+}
+
+
+//Arms limits for the next evaluation, clearing any previous halt.
+//  0 for unlimited fuel, milliseconds, or call depth
+void EVM::setLimits (uint64_t f, uint32_t ms, uint32_t d) {
+  halt = H_None;
+  fuel = f ? f : UINT64_MAX;
+  maxDepth = d;
+  hasDeadline = ms;
+  deadline = chrono::steady_clock::now() + chrono::milliseconds(ms);
+}
+
+//Consumes one unit of fuel, returning true if evaluation must unwind.
+//  The clock is only read every 4096 units
+bool EVM::tick () {
+  if (--fuel & 0xFFF) return halt;
+  return checkLimits();
+}
+
+bool EVM::checkLimits () {
+  if (halt) return true;
+  if (!fuel)
+    halt = H_Fuel;
+  else if (hasDeadline && chrono::steady_clock::now() > deadline)
+    halt = H_Time;
+  return halt;
 }
 
 
 Value EVM::exeFunc (fid id, Cell* params) {
-  auto func = funcs.get(id);
+  auto func = funcs->get(id);
   if (!func) return Value();
+  if (maxDepth && depth == maxDepth) {
+    halt = H_Depth;
+    return Value();
+  }
+  ++depth;
   Value ret;
-  for (uint i = 0, iLen = func->size(); i < iLen; ++i) {
+  for (uint i = 0, iLen = func->size(); i < iLen && !halt; ++i) {
     ret = eval(func->at(i), params);
     if (recurGarbage) {
       delete recurGarbage;
@@ -84,6 +168,14 @@ Value EVM::exeFunc (fid id, Cell* params) {
       params = recurGarbage = recurArgs;
     }
   }
+  --depth;
+  //Unwinding: discard a pending recur
+  if (halt) {
+    doRecur = false;
+    delete recurGarbage;
+    recurGarbage = nullptr;
+    return Value();
+  }
   return ret;
 }
 
@@ -165,34 +257,146 @@ Value o_BN (Value v) {
   return Value();
 }
 
+static bool isBits (Value &v) {
+  return v.type() == T_Pack && pack(v)->type == T_Bool;
+}
+
+//Returns finite lists of booleans combined as bitsets a word at a time,
+//  to the length of the shortest, or one inverted
+Value EVM::o_Bits (Cell* a, Op op) {
+  auto sets = vector<Value>();
+  veclen len = -1;
+  for (; a; a = a->next) {
+    Value bits = finite(a->val);
+    if (!isBits(bits)) return Value();
+    len = sets.empty() ? pack(bits)->len : min(len, pack(bits)->len);
+    sets.push_back(bits);
+  }
+  Pack* p = pack(sets[0])->slice(0, len);
+  uint64_t* out = p->words();
+  veclen words = p->bytes(len) / 8;
+  if (op == O_BN)
+    for (veclen w = 0; w < words; ++w)
+      out[w] = ~out[w];
+  for (veclen s = 1, sLen = sets.size(); s < sLen; ++s) {
+    uint64_t* in = pack(sets[s])->words();
+    switch (op) {
+      case O_BA:  for (veclen w = 0; w < words; ++w) out[w] &= in[w]; break;
+      case O_BO:  for (veclen w = 0; w < words; ++w) out[w] |= in[w]; break;
+      case O_BXO: for (veclen w = 0; w < words; ++w) out[w] ^= in[w]; break;
+    }
+  }
+  if (len % 64)
+    out[len / 64] &= (1ull << len % 64) - 1;
+  return Value(Data{.ptr=p}, T_Pack);
+}
+
 bool areEqual (Value v0, Value v1) {
   return v0.u32() == v1.u32();
 }
 
+//Compares T_Vecs of one length by chunk, skipping chunks the two share
+bool EVM::vecsAlike (Value &v0, Value &v1) {
+  auto chunks = vector<pair<const Value*, const Value*>>();
+  immer::for_each_chunk(*vec(v0), [&](const Value* from, const Value* to) {
+    chunks.push_back({from, to});
+  });
+  size_t c = 0;
+  const Value* at = chunks.size() ? chunks[0].first : nullptr;
+  return immer::for_each_chunk_p(*vec(v1), [&](const Value* from, const Value* to) {
+    while (from < to) {
+      if (at == chunks[c].second)
+        at = chunks[++c].first;
+      veclen n = min(to - from, chunks[c].second - at);
+      if (at != from)
+        for (veclen i = 0; i < n; ++i)
+          if (halt || !areAlike(at[i], from[i]))
+            return false;
+      from += n;
+      at += n;
+    }
+    return true;
+  });
+}
+
 bool EVM::areAlike (Value v0, Value v1) {
+  if (int known = knownAlike(v0, v1); known >= 0)
+    return known;
   Type type0 = v0.type();
   Type type1 = v1.type();
   //Ensure mutual comparison for floats
   if ((type0 == T_D32 || type1 == T_D32) && (type0 != type1))
     return false;
-  //Compare strings
-  if (type0 == T_Str) //Guaranteed mutual types
-    return !v0.str().compare(v1.str());
+  //Compare strings, or a string and a Lizt of a string, by character
+  if (type0 == T_Str || type0 == T_Rope || type1 == T_Str || type1 == T_Rope) {
+    string hold0, hold1;
+    string_view chars0, chars1;
+    return strChars(v0, chars0, hold0) && strChars(v1, chars1, hold1) && chars0 == chars1;
+  }
   else
   //Match infinite Lizt and Nil
   if ((type0 == T_N && type1 == T_Lizt)
    || (type0 == T_Lizt && type1 == T_N))
     return (type0 == T_Lizt ? v0.lizt() : v1.lizt())->isInf();
   else
-  //Compare lists by item
-  if ((type0 == T_Vec || type0 == T_Lizt)
-   && (type1 == T_Vec || type1 == T_Lizt)) {
+  //Compare sets by item, and maps by key and value
+  if (type0 == T_Set && type1 == T_Set)
+    return ValueAlike{}(v0, v1);
+  else
+  if (type0 == T_Map && type1 == T_Map) {
+    if (hashMap(v0)->size() != hashMap(v1)->size())
+      return false;
+    for (auto &[key, val] : *hashMap(v0)) {
+      auto found = hashMap(v1)->find(key);
+      if (!found || !areAlike(val, *found))
+        return false;
+    }
+    return true;
+  }
+  else
+  //Compare sorted sets and maps by entry in order
+  if ((type0 == T_SMap || type0 == T_SSet) && type0 == type1) {
+    Sorted* s0 = sorted(v0), *s1 = sorted(v1);
+    if (s0->size() != s1->size())
+      return false;
+    for (veclen i = 0, iLen = s0->size(); i < iLen && !halt; ++i) {
+      auto [key0, val0] = s0->at(i);
+      auto [key1, val1] = s1->at(i);
+      if (!ValueAlike{}(key0, key1) || !areAlike(val0, val1))
+        return false;
+    }
+    return true;
+  }
+  else
+  //Compare records of a type by field
+  if (type0 == T_Rec && type1 == T_Rec) {
+    Record* r0 = record(v0), *r1 = record(v1);
+    if (r0->layout != r1->layout)
+      return false;
+    for (uint16_t f = 0; f < r0->size && !halt; ++f)
+      if (!areAlike(r0->fields()[f], r1->fields()[f]))
+        return false;
+    return true;
+  }
+  else
+  //Compare lists by their hashes, kept from the first comparison, then by item
+  if (isVec(type0) && isVec(type1)) {
+    if (Lizt::length(v0) != Lizt::length(v1))
+      return false;
+    ValueHash{}(v0);
+    ValueHash{}(v1);
+    if (int known = knownAlike(v0, v1); known >= 0)
+      return known;
+  }
+  if (type0 == T_Vec && type1 == T_Vec)
+    return vecsAlike(v0, v1);
+  if ((isVec(type0) || type0 == T_Lizt)
+   && (isVec(type1) || type1 == T_Lizt)) {
     Lizt lizt0 = hcpy(Lizt::list(v0));
     Lizt lizt1 = hcpy(Lizt::list(v1));
-    if ((lizt0.len != lizt1.len)
-     || (lizt0.isInf() && lizt1.isInf()))
+    if (lizt0.isInf() || lizt1.isInf() || lizt0.len != lizt1.len)
       return false;
-    for (veclen i = 0, lLen = lizt0.len; i < lLen; ++i)
+    for (veclen i = 0, lLen = lizt0.len; i < lLen && !halt; ++i)
       if (!areAlike(liztAt(&lizt0, i), liztAt(&lizt1, i)))
         return false;
     return true;
@@ -204,12 +408,17 @@ bool EVM::areAlike (Value v0, Value v1) {
 bool numDiff (Value v0, Value v1, bool greater) {
   Type type0 = v0.type();
   Type type1 = v1.type();
-  //Compare strings
-  if (type0 == T_Str) //Guaranteed mutual types
-    return v0.str().compare(v1.str()) == (greater ? 1 : -1);
+  //Compare strings, or a string and a Lizt of a string, by character
+  string hold0, hold1;
+  string_view chars0, chars1;
+  if ((type0 == T_Str || type0 == T_Rope || type1 == T_Str || type1 == T_Rope)
+   && strChars(v0, chars0, hold0) && strChars(v1, chars1, hold1)) {
+    int c = chars0.compare(chars1);
+    return greater ? c < 0 : c > 0;
+  }
   //Compare lists by length
-  if ((type0 == T_Vec || type0 == T_Lizt)
-   && (type1 == T_Vec || type1 == T_Lizt))
+  if ((isVec(type0) || type0 == T_Lizt)
+   && (isVec(type1) || type1 == T_Lizt))
     return greater
       ? (Lizt::length(v0) < Lizt::length(v1))
       : (Lizt::length(v0) > Lizt::length(v1));
@@ -225,8 +434,11 @@ Value EVM::o_Equal (Cell* a, Op op) {
   //Loop will break early on false comparison
   while ((a = a->next)) {
     Value v1 = a->val;
-    if ((v0.type() == T_Str || v1.type() == T_Str) && v0.type() != v1.type())
-      break; //Mutual string comparison only
+    string hold;
+    string_view chars;
+    if ((v0.type() == T_Str || v1.type() == T_Str) && v0.type() != v1.type()
+     && !strChars(v0.type() == T_Str ? v1 : v0, chars, hold))
+      break; //Mutual string comparison only, or with a Lizt of a string
     switch (op) {
       case O_Alike: case O_NAlike:
         if (areAlike(v0, v1) ^ (op == O_Alike))
@@ -252,13 +464,14 @@ Value EVM::o_Equal (Cell* a, Op op) {
 }
 
 
+//Returns a T_Pack of numbers or booleans of one type, otherwise a T_Vec
 Value EVM::o_Vec (Cell* a) {
-  auto vect = immer::vector_transient<Value>();
+  auto items = vector<Value>();
   while (a) {
-    vect.push_back(a->val);
+    items.push_back(a->val);
     a = a->next;
   }
-  return Value(Data{.ptr=new immer::vector<Value>(vect.persistent())}, T_Vec);
+  return listOf(items);
 }
 
 
@@ -266,7 +479,7 @@ Value EVM::o_Vec (Cell* a) {
 //  e.g. (skip n vec)
 Value EVM::o_Skip (Cell* a) {
   if (numArgs(a) != 2) return Value();
-  auto take = new Lizt::Take{Lizt::list(a->next->val), a->val.s32(), -1};
+  auto take = new Lizt::Take{Lizt::list(a->next->val), toLen(a->val), -1};
   return Value(Data{.ptr=Lizt::take(take)}, T_Lizt);
 }
 
@@ -276,11 +489,9 @@ Value EVM::o_Skip (Cell* a) {
 Value EVM::o_Take (Cell* a) {
   argnum n = numArgs(a);
   if (n < 2) return Value();
-  auto takeN = a->val.s32();
-  auto skipN = n == 3 ? a->next->val.s32() : 0;
+  veclen takeN = toLen(a->val);
+  veclen skipN = n == 3 ? toLen(a->next->val) : 0;
   Lizt* lizt = Lizt::list(valAt(a, n == 2 ? 1 : 2));
-  if (!lizt->isInf() && skipN + takeN > lizt->len)
-    takeN = lizt->len - skipN;
   if (takeN < 0) takeN = 0;
   auto take = new Lizt::Take{lizt, skipN, takeN};
   return Value(Data{.ptr=Lizt::take(take)}, T_Lizt);
@@ -290,18 +501,24 @@ Value EVM::o_Take (Cell* a) {
 //Returns a range Lizt.
 //  e.g. (range) (range to) (range from to) (range from to step)
 Value EVM::o_Range (Cell* a) {
-  int32_t from = 0, to = 0, step = a ? 1 : 0;
+  int64_t from = 0, to = 0, step = 1;
   auto n = numArgs(a);
-  if (n == 1) to = a->val.s32();
+  if (n == 1) to = toLen(a->val);
   else if (n > 1) {
-    from = a->val.s32();
-    to = a->next->val.s32();
+    from = toLen(a->val);
+    to = toLen(a->next->val);
     if (n == 3)
-      step = a->next->next->val.s32();
+      step = toLen(a->next->next->val);
   }
-  if (n != 3 && to < 0)
+  if (n != 3 && to < from)
     step = -1;
-  return Value(Data{.ptr=Lizt::range(Lizt::Range{from, to, step})}, T_Lizt);
+  veclen len = 0;
+  if (n && step) {
+    auto span = to - from;
+    len = max(span / step + (span % step != 0), (int64_t)0);
+  }
+  auto range = Lizt::range(Lizt::Range{from, step}, len, !n || !step);
+  return Value(Data{.ptr=range}, T_Lizt);
 }
 
 
@@ -317,8 +534,17 @@ Value EVM::o_Cycle (Cell* a) {
 
 Value EVM::o_Emit (Cell* a) {
   if (!a) return Value();
-  veclen len = a->next ? a->next->val.s32() : -1;
-  return Value(Data{.ptr=Lizt::emit(a->val, len)}, T_Lizt);
+  veclen len = a->next ? max(toLen(a->next->val), (veclen)0) : 0;
+  return Value(Data{.ptr=Lizt::emit(a->val, len, !a->next)}, T_Lizt);
+}
+
+
+//Returns an infinite generator Lizt.
+//  e.g. (iterate f seed) => seed (f seed) (f (f seed)) ...
+//       (unfold f seed) where (f seed) => [item next-seed]
+Value EVM::o_Gen (Cell* a, LiztT type) {
+  if (numArgs(a) != 2 || !isCallType(a)) return Value();
+  return Value(Data{.ptr=Lizt::gen(type, new Cell{a->val}, a->next->val)}, T_Lizt);
 }
 
 
@@ -332,34 +558,1132 @@ Value EVM::o_Map (Cell* a) {
 }
 
 
-//Returns a filtered T_Vec from a T_Lizt
+//Returns a Lizt which computes each item of its source at most once.
+//  e.g. (memo (map expensive (range)))
+Value EVM::o_Memo (Cell* a) {
+  if (!a) return Value();
+  return Value(Data{.ptr=Lizt::memo(Lizt::list(a->val))}, T_Lizt);
+}
+
+
+//Returns a filtered T_Vec or T_Pack from a finite source,
+//  or a lazily filtered Lizt from an infinite source
 // e.g. (where f lizt) (where f take lizt) (where f take skip lizt)
 Value EVM::o_Where (Cell* a) {
   if (!isCallType(a)) return Value();
   auto n = numArgs(a);
-  Lizt lizt = hcpy(Lizt::list(valAt(a, n - 1)));
-  if (lizt.isInf()) return Value();
-  veclen skipN = n == 4 ? valAt(a, 2).s32() : 0;
-  uint   takeN = n >= 3 ? valAt(a, 1).s32() : lizt.len;
-  auto list = immer::vector_transient<Value>();
+  Lizt* source = Lizt::list(valAt(a, n - 1));
+  veclen skipN = n == 4 ? max(toLen(valAt(a, 2)), (veclen)0) : 0;
+  if (source->isInf()) {
+    if (skipN)
+      source = Lizt::take(new Lizt::Take{source, skipN, -1});
+    Lizt* lizt = Lizt::where(new Cell{a->val}, source);
+    if (n >= 3)
+      lizt = Lizt::take(new Lizt::Take{lizt, 0, max(toLen(valAt(a, 1)), (veclen)0)});
+    return Value(Data{.ptr=lizt}, T_Lizt);
+  }
+  Lizt lizt = hcpy(source);
+  veclen takeN = n >= 3 ? max(toLen(valAt(a, 1)), (veclen)0) : lizt.len, kept = 0;
+  if (Value found; whereKernel(a, &lizt, skipN, takeN, found))
+    return found;
+  //Characters of a string are kept as a string
+  bool isStr = lizt.type == P_Str;
+  auto list = vector<Value>();
+  auto str = string();
   Cell head = Cell{a->val};
   Cell form = Cell{Value(Data{.cell=&head}, T_Cell)};
-  for (veclen i = skipN; i < lizt.len && list.size() < takeN; ++i) {
-    Value testVal = liztAt(&lizt, i);
+  Cursor c = cursor(&lizt, skipN);
+  for (veclen i = skipN; i < lizt.len && kept < takeN && !halt; ++i) {
+    Value testVal = next(c);
     Cell valCell = Cell{testVal};
     head.next = &valCell;
     Value v = eval(&form);
     if (!v.tru()) continue;
-    list.push_back(testVal);
+    ++kept;
+    if (isStr) str += testVal.s08();
+    else list.push_back(testVal);
   }
   head.next = nullptr;
   form.val.kill(); //To ensure head isn't deleted
-  auto iVec = new immer::vector<Value>(list.persistent());
-  return Value(Data{.ptr=iVec}, T_Vec);
+  if (isStr) return Value(Data{.ptr=new string(str)}, T_Str);
+  return listOf(list);
+}
+
+
+//Returns the sum of a range or integer emit Lizt's items from an index,
+//  as the bits of a 32-bit integer, or false if there is no closed form
+bool sumOf (Lizt* l, veclen from, uint32_t &sum) {
+  //Unsigned, as only the low 32 bits are kept
+  uint64_t n = l->len - from;
+  if (l->type == P_Range) {
+    auto r = (Lizt::Range*)l->config;
+    uint64_t first = r->from + from * r->step;
+    uint64_t pairs = n % 2 ? (n - 1) / 2 * n : n / 2 * (n - 1);
+    sum = n * first + r->step * pairs;
+    return true;
+  }
+  if (l->type == P_Emit) {
+    auto v = *(Value*)l->config;
+    if (v.type() < T_U08 || v.type() > T_S32) return false;
+    sum = n * v.u32c();
+    return true;
+  }
+  return false;
+}
+
+//Folds a list into one value, ending early on (reduced x).
+//  Native ops are applied without a form per item,
+//  and sums of finite ranges and emits are closed-form.
+//  An infinite list is folded until (reduced x).
+//  e.g. (reduce f list) (reduce f init list)
+Value EVM::o_Reduce (Cell* a) {
+  auto n = numArgs(a);
+  if (n < 2 || !isCallType(a)) return Value();
+  Lizt lizt = hcpy(Lizt::list(valAt(a, n - 1)));
+  bool isInf = lizt.isInf();
+  Cursor c = cursor(&lizt);
+  veclen i = 0;
+  Cell head = Cell{a->val}, acc, item;
+  if (n == 3)
+    acc.val = a->next->val;
+  else if (isInf || lizt.len) {
+    acc.val = next(c);
+    ++i;
+  } else return Value();
+  Op op = head.val.op();
+  Type t = acc.val.type();
+  bool isInt = T_U08 <= t && t <= T_S32;
+  //Closed-form sum
+  if (op == O_Add && isInt && !isInf)
+    if (uint32_t sum; sumOf(&lizt, i, sum)) {
+      sum += acc.val.u32c();
+      if (acc.val.size() == 1 && acc.val.hasSign()) sum &= 0xFF;
+      return Value(Data{.u32=sum}, t);
+    }
+  //Native ops other than short-circuited forms don't need a form
+  bool native = op > O_Delay;
+  //Vectorized integer fold
+  if (native && isInt && !isInf) {
+    Type itemT;
+    vector<uint32_t> buf;
+    uint32_t bits = acc.val.u32c();
+    auto items = gatherNums(&lizt, itemT, buf);
+    if (items && itemT != T_D32
+     && Kernel::fold(op, items + i, lizt.len - i, bits)) {
+      if (acc.val.size() == 1 && acc.val.hasSign()) bits &= 0xFF;
+      return Value(Data{.u32=bits}, t);
+    }
+  }
+  head.next = &acc;
+  acc.next = &item;
+  reduced = false;
+  for (; (isInf || i < lizt.len) && !halt; ++i) {
+    item.val = next(c);
+    if (native) {
+      if (tick()) break;
+      acc.val = exeOp(op, &acc);
+    } else acc.val = apply(&head);
+    if (reduced) break;
+    //Stop on an absorbing integer zero
+    if (isInt && !acc.val.u32() && (op == O_Mul || op == O_BA)) break;
+  }
+  reduced = false;
+  head.next = acc.next = nullptr;
+  return acc.val;
+}
+
+
+//Sorts a finite list ascending, as a T_Vec or T_Pack: numbers by value,
+//  then strings by bytes, then lists by length. Infinite lists return N
+//  e.g. (sort list)
+Value EVM::o_Sort (Cell* a) {
+  if (!a) return Value();
+  Lizt lizt = hcpy(Lizt::list(a->val));
+  if (lizt.isInf()) return Value();
+  veclen len = lizt.len;
+  Value list = realize(a->val, len);
+  if (halt) return Value();
+  //Radix sort homogeneous U08/S32/U32/D32 items
+  Lizt items = hcpy(Lizt::list(list));
+  Type t;
+  auto buf = vector<uint32_t>();
+  if (auto nums = gatherNums(&items, t, buf)) {
+    if (nums != buf.data()) buf.assign(nums, nums + len);
+    Sort::radix(buf.data(), nullptr, len, t);
+    return numsToPack(buf.data(), len, t);
+  }
+  auto keys = vector<Value>(len);
+  auto order = vector<uint32_t>(len);
+  for (veclen i = 0; i < len; ++i) {
+    keys[i] = vecAt(list, i);
+    order[i] = i;
+  }
+  Sort::byKeys(keys, order);
+  auto sorted = vector<Value>();
+  sorted.reserve(len);
+  for (auto i : order)
+    sorted.push_back(keys[i]);
+  return listOf(sorted);
+}
+
+//Stably sorts a finite list by the results of f on each item,
+//  ordered as with sort. Infinite lists return N
+//  e.g. (sort-by f list)
+Value EVM::o_SortBy (Cell* a) {
+  if (!isCallType(a) || !a->next) return Value();
+  Lizt lizt = hcpy(Lizt::list(a->next->val));
+  if (lizt.isInf()) return Value();
+  veclen len = lizt.len;
+  Value list = realize(a->next->val, len);
+  auto keys = vector<Value>(len);
+  auto order = vector<uint32_t>(len);
+  for (veclen i = 0; i < len && !halt; ++i) {
+    Cell head = Cell{a->val};
+    head.next = new Cell{vecAt(list, i)};
+    keys[i] = apply(&head);
+    order[i] = i;
+  }
+  if (halt) return Value();
+  //Radix sort indices by homogeneous U08/S32/U32/D32 keys
+  Type t = len ? keys[0].type() : T_N;
+  bool isNum = t == T_U08 || t == T_S32 || t == T_U32 || t == T_D32;
+  for (veclen i = 1; i < len && isNum; ++i)
+    isNum = keys[i].type() == t;
+  if (isNum) {
+    auto bits = vector<uint32_t>(len);
+    for (veclen i = 0; i < len; ++i)
+      bits[i] = t == T_U08 ? keys[i].u08() : keys[i].u32();
+    Sort::radix(bits.data(), order.data(), len, t);
+  } else Sort::byKeys(keys, order);
+  auto sorted = vector<Value>();
+  sorted.reserve(len);
+  for (auto i : order)
+    sorted.push_back(vecAt(list, i));
+  return listOf(sorted);
+}
+
+
+//Returns a Value usable as a map key or set item: finite Lizts are
+//  realized, those of a string's characters as a string, and infinite
+//  Lizts become N, to which they are alike. Vectors and records holding
+//  Lizts are copied with them realized, as Lizts are hashed and compared
+//  as keys by identity
+Value EVM::keyOf (Value v) {
+  Type t = v.type();
+  if (t == T_Lizt) {
+    string hold;
+    string_view chars;
+    if (strChars(v, chars, hold))
+      return Value(Data{.ptr=new string(chars)}, T_Str);
+    return keyOf(liztFrom(v.lizt(), 0));
+  }
+  //A kept hash means it holds no Lizts
+  if (t == T_Vec && !v.cachedHash()) {
+    auto items = vector<Value>();
+    bool isChanged = false;
+    for (veclen i = 0, iLen = Lizt::length(v); i < iLen; ++i) {
+      Value item = vecAt(v, i);
+      items.push_back(keyOf(item));
+      isChanged = isChanged || items.back().ptr() != item.ptr();
+    }
+    return isChanged ? listOf(items) : v;
+  }
+  if (t == T_Rec) {
+    Record* r = record(v);
+    Value rec = v;
+    for (uint16_t f = 0; f < r->size; ++f) {
+      Value field = keyOf(r->fields()[f]);
+      if (field.ptr() == r->fields()[f].ptr()) continue;
+      if (rec.ptr() == v.ptr())
+        rec = Value(Data{.ptr=r->copy()}, T_Rec);
+      record(rec)->fields()[f] = field;
+    }
+    return rec;
+  }
+  return v;
+}
+
+//Returns a T_Map of keys to values, with a trailing key mapped to N
+//  e.g. (hash-map k v k v ...) {k v k v ...}
+Value EVM::o_HashMap (Cell* a) {
+  auto m = HashMap().transient();
+  for (; a; a = a->next ? a->next->next : nullptr)
+    m.set(keyOf(a->val), a->next ? a->next->val : Value());
+  return Value(Data{.ptr=new HashMap(m.persistent())}, T_Map);
+}
+
+//Returns a T_Set of distinct items
+//  e.g. (hash-set x y z ...) #{x y z ...}
+Value EVM::o_HashSet (Cell* a) {
+  auto s = HashSet().transient();
+  for (; a; a = a->next)
+    s.insert(keyOf(a->val));
+  return Value(Data{.ptr=new HashSet(s.persistent())}, T_Set);
+}
+
+//Returns a T_SMap of keys to values, or a T_SSet of items, ordered as
+//  with sort, with a trailing key mapped to N
+//  e.g. (sorted-map k v k v ...) (sorted-set x y z ...)
+Value EVM::o_Sorted (Cell* a, bool isMap) {
+  auto keys = vector<Value>(), vals = vector<Value>();
+  for (; a; a = a->next) {
+    keys.push_back(keyOf(a->val));
+    if (!isMap) continue;
+    vals.push_back(a->next ? a->next->val : Value());
+    if (!(a = a->next)) break;
+  }
+  return Value(Data{.ptr=new Sorted(isMap, keys, vals)}, isMap ? T_SMap : T_SSet);
+}
+
+//Returns a Lizt of the entries of a T_SMap or T_SSet from lo to hi
+//  inclusive in order, either N for no bound
+//  e.g. (between m lo hi)
+Value EVM::o_Between (Cell* a) {
+  if (numArgs(a) != 3) return Value();
+  Value coll = a->val;
+  if (coll.type() != T_SMap && coll.type() != T_SSet) return Value();
+  Sorted* s = sorted(coll);
+  Value lo = keyOf(a->next->val), hi = keyOf(a->next->next->val);
+  veclen from = lo.type() == T_N ? 0 : s->rank(lo);
+  veclen to = hi.type() == T_N ? s->size() : s->rank(hi, true);
+  return Value(Data{.ptr=Lizt::span(coll, from, max(to - from, (veclen)0))}, T_Lizt);
+}
+
+//Returns the value of a key of a T_Map or T_SMap, or the item of a
+//  T_Set or T_SSet alike to it, or the item of a list at an index,
+//  otherwise the default or N
+//  e.g. (get m key) (get m key default) (get v i)
+Value EVM::o_Get (Cell* a) {
+  if (numArgs(a) < 2) return Value();
+  Type t = a->val.type();
+  if (isVec(t) || t == T_Lizt || t == T_Str)
+    return nth(a->val, a->next->val, a->next->next ? a->next->next->val : Value());
+  Value coll = a->val, key = keyOf(a->next->val);
+  if (coll.type() == T_Map)
+    if (auto found = hashMap(coll)->find(key))
+      return *found;
+  if (coll.type() == T_Set)
+    if (auto found = hashSet(coll)->find(key))
+      return *found;
+  if (coll.type() == T_SMap || coll.type() == T_SSet)
+    if (auto found = sorted(coll)->find(key))
+      return *found;
+  return a->next->next ? a->next->next->val : Value();
+}
+
+//Returns an index as a number, or -1 if it isn't a non-negative integer
+static int64_t toIndex (Value v) {
+  if (v.type() < T_U08 || v.type() > T_S32) return -1;
+  return v.hasSign() ? max<int64_t>(v.s32c(), -1) : (int64_t)v.u32c();
+}
+
+//Returns a T_Map or T_SMap with keys set to values, a trailing key to N,
+//  or a list with items set at indices, or appended at its length.
+//  A unique T_Pack is set in place if the items keep its type,
+//  otherwise lists are set as a T_Vec in O(log n)
+//  e.g. (assoc m k v k v ...) (assoc v i x i x ...)
+Value EVM::o_Assoc (Cell* a) {
+  if (!a) return Value();
+  if (a->val.type() == T_Pack) {
+    Pack* p = pack(a->val);
+    bool inPlace = a->val.isUnique();
+    for (Cell* c = a->next; c && inPlace; c = c->next ? c->next->next : nullptr)
+      inPlace = c->next && toIndex(c->val) >= 0 && toIndex(c->val) < p->len
+             && c->next->val.type() == p->type;
+    if (inPlace) {
+      for (Cell* c = a->next; c; c = c->next->next)
+        p->set(toIndex(c->val), c->next->val.data());
+      return a->val;
+    }
+  }
+  if (isVec(a->val.type())) {
+    Value coll = boxed(a->val);
+    auto v = vec(coll)->transient();
+    for (a = a->next; a; a = a->next ? a->next->next : nullptr) {
+      int64_t i = toIndex(a->val);
+      Value item = a->next ? a->next->val : Value();
+      if (i >= 0 && i < (int64_t)v.size()) v.set(i, item);
+      else if (i == (int64_t)v.size()) v.push_back(item);
+    }
+    return Value(Data{.ptr=new immer::flex_vector<Value>(v.persistent())}, T_Vec);
+  }
+  if (a->val.type() == T_SMap) {
+    Sorted s = *sorted(a->val);
+    for (a = a->next; a; a = a->next ? a->next->next : nullptr)
+      s = s.with(keyOf(a->val), a->next ? a->next->val : Value());
+    return Value(Data{.ptr=new Sorted(s)}, T_SMap);
+  }
+  if (a->val.type() != T_Map) return Value();
+  auto m = hashMap(a->val)->transient();
+  for (a = a->next; a; a = a->next ? a->next->next : nullptr)
+    m.set(keyOf(a->val), a->next ? a->next->val : Value());
+  return Value(Data{.ptr=new HashMap(m.persistent())}, T_Map);
+}
+
+//Returns a T_Map or T_SMap without keys, or a T_Set or T_SSet without items
+//  e.g. (dissoc m k ...) (dissoc s x ...)
+Value EVM::o_Dissoc (Cell* a) {
+  if (!a) return Value();
+  Value coll = a->val;
+  if (coll.type() == T_SMap || coll.type() == T_SSet) {
+    Sorted s = *sorted(coll);
+    for (a = a->next; a; a = a->next)
+      s = s.without(keyOf(a->val));
+    return Value(Data{.ptr=new Sorted(s)}, coll.type());
+  }
+  if (coll.type() == T_Map) {
+    auto m = hashMap(coll)->transient();
+    for (a = a->next; a; a = a->next)
+      m.erase(keyOf(a->val));
+    return Value(Data{.ptr=new HashMap(m.persistent())}, T_Map);
+  }
+  if (coll.type() == T_Set) {
+    auto s = hashSet(coll)->transient();
+    for (a = a->next; a; a = a->next)
+      s.erase(keyOf(a->val));
+    return Value(Data{.ptr=new HashSet(s.persistent())}, T_Set);
+  }
+  return Value();
+}
+
+//Returns if a map has a key, or a set an item
+//  e.g. (contains? m key) (contains? s item)
+Value EVM::o_Contains (Cell* a) {
+  if (numArgs(a) != 2) return Value();
+  Value coll = a->val, key = keyOf(a->next->val);
+  bool has = false;
+  if (coll.type() == T_Map) has = hashMap(coll)->count(key);
+  if (coll.type() == T_Set) has = hashSet(coll)->count(key);
+  if (coll.type() == T_SMap || coll.type() == T_SSet)
+    has = sorted(coll)->find(key);
+  return Value(Data{.tru=has}, T_Bool);
+}
+
+//Returns the keys or values of a T_Map, or in order of a T_SMap
+//  e.g. (keys m) (vals m)
+Value EVM::o_Entries (Cell* a, bool isKeys) {
+  if (!a) return Value();
+  auto items = vector<Value>();
+  if (a->val.type() == T_Map)
+    for (auto &[key, val] : *hashMap(a->val))
+      items.push_back(isKeys ? key : val);
+  else if (a->val.type() == T_SMap)
+    sorted(a->val)->each([&](const Value &key, const Value &val) {
+      items.push_back(isKeys ? key : val);
+    });
+  else return Value();
+  return listOf(items);
+}
+
+
+//Returns an item of a list or string by index, else the fallback
+Value EVM::nth (Value coll, Value index, Value fallback) {
+  int64_t i = toIndex(index);
+  if (i < 0) return fallback;
+  Type t = coll.type();
+  if (isVec(t) && i < Lizt::length(coll))
+    return vecAt(coll, i);
+  if (t == T_Lizt && (coll.lizt()->isInf() || i < coll.lizt()->len))
+    return liztAt(coll.lizt(), i);
+  if (t == T_Str && i < (int64_t)((string*)coll.ptr())->size())
+    return Value(Data{.s08=(*(string*)coll.ptr())[i]}, T_S08);
+  if (t == T_Rope && i < (int64_t)rope(coll)->len)
+    return Value(Data{.s08=rope(coll)->at(i)}, T_S08);
+  return fallback;
+}
+
+//Returns an item of a list or string by index, otherwise the default or N.
+//  Vectors are indexed in O(log n), and packs in O(1)
+//  e.g. (nth list i) (nth list i default)
+Value EVM::o_Nth (Cell* a) {
+  if (numArgs(a) < 2) return Value();
+  return nth(a->val, a->next->val, a->next->next ? a->next->next->val : Value());
+}
+
+//Returns a collection with items added: appended to a list or N,
+//  or [key value] pairs set in a map. A unique T_Pack is grown in place
+//  if the items keep its type, otherwise lists are appended to as a T_Vec
+Value EVM::append (Value coll, vector<Value> &items, bool isUnique) {
+  Type t = coll.type();
+  if (t == T_Lizt) {
+    if (coll.lizt()->isInf()) return Value();
+    coll = liztFrom(coll.lizt(), 0);
+    t = coll.type();
+  }
+  if (t == T_N || (isVec(t) && !Lizt::length(coll)))
+    return listOf(items);
+  if (t == T_Pack && isUnique) {
+    Pack* p = pack(coll);
+    bool fits = true;
+    for (auto &item : items)
+      if (!(fits = item.type() == p->type)) break;
+    if (fits) {
+      veclen len = p->len;
+      p->resize(len + items.size());
+      for (veclen i = 0, iLen = items.size(); i < iLen; ++i)
+        p->set(len + i, items[i].data());
+      return coll;
+    }
+  }
+  if (t == T_Str) {
+    //Appended to in place if unique, characters as they are
+    auto str = isUnique ? (string*)coll.ptr() : new string(*(string*)coll.ptr());
+    for (auto &item : items)
+      if (item.type() == T_S08) *str += item.s08();
+      else *str += toStr(item);
+    return isUnique ? coll : Value(Data{.ptr=str}, T_Str);
+  }
+  if (t == T_Pack)
+    coll = boxed(coll);
+  if (coll.type() == T_Vec) {
+    auto v = vec(coll)->transient();
+    for (auto &item : items)
+      v.push_back(item);
+    return Value(Data{.ptr=new immer::flex_vector<Value>(v.persistent())}, T_Vec);
+  }
+  if (t == T_Set) {
+    auto s = hashSet(coll)->transient();
+    for (auto &item : items)
+      s.insert(keyOf(item));
+    return Value(Data{.ptr=new HashSet(s.persistent())}, T_Set);
+  }
+  if (t == T_SSet || t == T_SMap) {
+    Sorted s = *sorted(coll);
+    for (auto &item : items)
+      if (t == T_SSet) s = s.with(keyOf(item), Value());
+      else if (isVec(item.type()) && Lizt::length(item) == 2)
+        s = s.with(keyOf(vecAt(item, 0)), vecAt(item, 1));
+    return Value(Data{.ptr=new Sorted(s)}, t);
+  }
+  if (t == T_Map) {
+    auto m = hashMap(coll)->transient();
+    for (auto &item : items)
+      if (isVec(item.type()) && Lizt::length(item) == 2)
+        m.set(keyOf(vecAt(item, 0)), vecAt(item, 1));
+    return Value(Data{.ptr=new HashMap(m.persistent())}, T_Map);
+  }
+  return Value();
+}
+
+//Returns a collection with items added, as [key value] pairs to a map
+//  e.g. (conj coll x ...)
+Value EVM::o_Conj (Cell* a) {
+  if (!a) return Value();
+  auto items = vector<Value>();
+  for (Cell* c = a->next; c; c = c->next)
+    items.push_back(c->val);
+  return append(a->val, items, a->val.isUnique());
+}
+
+//Returns a collection with the items of a finite list added, read in one
+//  pass and added through a transient, as [key value] pairs to a map
+//  e.g. (into [] lizt) (into {} pairs) (into #{} list)
+Value EVM::o_Into (Cell* a) {
+  if (numArgs(a) != 2) return Value();
+  Lizt lizt = hcpy(Lizt::list(a->next->val));
+  if (lizt.isInf()) return Value();
+  auto items = vector<Value>();
+  items.reserve(lizt.len);
+  Cursor c = cursor(&lizt);
+  for (veclen i = 0; i < lizt.len && !halt; ++i)
+    items.push_back(next(c));
+  if (halt) return Value();
+  return append(a->val, items, a->val.isUnique());
+}
+
+
+//Returns the items of a finite list as one string built in one buffer,
+//  characters and strings as they are, between each a separator
+//  e.g. (join list) (join list sep)
+Value EVM::o_Join (Cell* a) {
+  if (!a) return Value();
+  Lizt lizt = hcpy(Lizt::list(a->val));
+  if (lizt.isInf()) return Value();
+  string sep = a->next ? toStr(a->next->val) : "";
+  auto str = string();
+  str.reserve(lizt.len);
+  Cursor c = cursor(&lizt);
+  for (veclen i = 0; i < lizt.len && !halt; ++i) {
+    if (i) str += sep;
+    Value item = next(c);
+    if (item.type() == T_S08) str += item.s08();
+    else str += toStr(item);
+  }
+  if (halt) return Value();
+  return Value(Data{.ptr=new string(str)}, T_Str);
 }
 
+static bool areStrs (Cell* a, argnum n) {
+  for (; n--; a = a->next)
+    if (!a || a->val.type() != T_Str) return false;
+  return true;
+}
+
+//Returns the index of the first occurrence of a substring from an index,
+//  or N, scanning the string 32 bytes at a time
+//  e.g. (find s sub) (find s sub from)
+Value EVM::o_Find (Cell* a) {
+  if (!areStrs(a, 2)) return Value();
+  auto &str = *(string*)a->val.ptr(), &sub = *(string*)a->next->val.ptr();
+  int64_t from = a->next->next ? toIndex(valAt(a, 2)) : 0;
+  if (from < 0 || from > (int64_t)str.size()) return Value();
+  veclen at = Kernel::find(str.data() + from, str.size() - from, sub.data(), sub.size());
+  if (at < 0) return Value();
+  return lenOf(from + at);
+}
+
+//Returns a string split at each occurrence of a separator, as a vector of
+//  strings, or into characters as strings by an empty separator
+//  e.g. (split s sep)
+Value EVM::o_Split (Cell* a) {
+  if (!areStrs(a, 2)) return Value();
+  auto &str = *(string*)a->val.ptr(), &sep = *(string*)a->next->val.ptr();
+  auto parts = vector<Value>();
+  veclen from = 0, len = str.size();
+  while (from < len || (sep.size() && from == len)) {
+    veclen at = sep.empty() ? 1 : Kernel::find(str.data() + from, len - from, sep.data(), sep.size());
+    if (at < 0) at = len - from;
+    parts.push_back(Value(Data{.ptr=new string(str, from, at)}, T_Str));
+    from += at + sep.size();
+  }
+  return listOf(parts);
+}
+
+//Returns a string with each occurrence of a substring replaced
+//  e.g. (replace s from to)
+Value EVM::o_Replace (Cell* a) {
+  if (!areStrs(a, 3)) return Value();
+  auto &str = *(string*)a->val.ptr(), &sub = *(string*)a->next->val.ptr();
+  auto &with = *(string*)valAt(a, 2).ptr();
+  if (sub.empty()) return a->val;
+  auto out = new string();
+  out->reserve(str.size());
+  veclen from = 0, len = str.size();
+  while (true) {
+    veclen at = Kernel::find(str.data() + from, len - from, sub.data(), sub.size());
+    if (at < 0) break;
+    out->append(str, from, at);
+    *out += with;
+    from += at + sub.size();
+  }
+  out->append(str, from, len - from);
+  return Value(Data{.ptr=out}, T_Str);
+}
+
+//Returns if a string begins with a prefix
+//  e.g. (starts-with? s prefix)
+Value EVM::o_StartsWith (Cell* a) {
+  if (!areStrs(a, 2)) return Value();
+  auto &str = *(string*)a->val.ptr(), &prefix = *(string*)a->next->val.ptr();
+  bool has = !str.compare(0, prefix.size(), prefix);
+  return Value(Data{.tru=has}, T_Bool);
+}
+
+//Returns the number of truthy items of a finite list,
+//  counting the bits of a bitset a word at a time
+//  e.g. (count list)
+Value EVM::o_Count (Cell* a) {
+  if (!a) return Value();
+  Value list = finite(a->val);
+  if (list.type() == T_N) return Value();
+  veclen n = 0;
+  if (isBits(list)) {
+    Pack* p = pack(list);
+    for (veclen w = 0, wLen = p->bytes(p->len) / 8; w < wLen; ++w)
+      n += __builtin_popcountll(p->words()[w]);
+  } else
+    for (veclen i = 0, iLen = Lizt::length(list); i < iLen; ++i)
+      n += vecAt(list, i).tru();
+  return lenOf(n);
+}
+
+//Returns the indices of the truthy items of a finite list,
+//  taking the set bits of a bitset a word at a time
+//  e.g. (indices list)
+Value EVM::o_Indices (Cell* a) {
+  if (!a) return Value();
+  Value list = finite(a->val);
+  if (list.type() == T_N) return Value();
+  auto found = vector<uint32_t>();
+  if (isBits(list)) {
+    Pack* p = pack(list);
+    for (veclen w = 0, wLen = p->bytes(p->len) / 8; w < wLen; ++w)
+      for (uint64_t word = p->words()[w]; word; word &= word - 1)
+        found.push_back(w * 64 + __builtin_ctzll(word));
+  } else
+    for (veclen i = 0, iLen = Lizt::length(list); i < iLen; ++i)
+      if (vecAt(list, i).tru()) found.push_back(i);
+  //Ascending, so typed by the last
+  bool isWide = found.size() && found.back() > INT32_MAX;
+  return numsToPack(found.data(), found.size(), isWide ? T_U32 : T_S32);
+}
+
+//Returns an instance of a record type with its fields, any missing as N.
+//  Written by the parser for a record type's name
+//  e.g. (Point 1 2) => (record layout 1 2)
+Value EVM::o_Record (Cell* a) {
+  if (!a || a->val.type() != T_U32) return Value();
+  Layout* layout = Layout::at(a->val.u32());
+  if (!layout) return Value();
+  Record* r = Record::make(a->val.u32(), layout->fields.size());
+  a = a->next;
+  for (uint16_t f = 0; f < r->size && a; ++f, a = a->next)
+    r->fields()[f] = a->val;
+  return Value(Data{.ptr=r}, T_Rec);
+}
+
+//Returns a field of a record by its slot, or the record with the field
+//  set, in place if it is unique. A record of another type gives N.
+//  Written by the parser for a record type's field
+//  e.g. (Point.y p) => (field layout 1 p) (Point.y p 5) => (field layout 1 p 5)
+Value EVM::o_Field (Cell* a) {
+  if (numArgs(a) < 3 || a->next->next->val.type() != T_Rec) return Value();
+  //Checked before rec also refers to it
+  bool isUnique = a->next->next->val.isUnique();
+  Value rec = a->next->next->val;
+  Record* r = record(rec);
+  uint32_t slot = a->next->val.u32();
+  if (r->layout != a->val.u32() || slot >= r->size) return Value();
+  Cell* set = a->next->next->next;
+  if (!set) return r->fields()[slot];
+  if (!isUnique)
+    rec = Value(Data{.ptr=r = r->copy()}, T_Rec);
+  r->fields()[slot] = set->val;
+  return rec;
+}
+
+//Returns a finite list, Lizt or collection as a T_Vec or T_Pack, else N
+Value EVM::finite (Value v) {
+  if (isVec(v.type())) return v;
+  Lizt* l = Lizt::list(v);
+  Value list = liztFrom(l, 0);
+  delete l;
+  return list;
+}
+
+//Returns items [from, to) of a T_Vec in O(log n), or copied from a T_Pack
+static Value slice (Value &list, veclen from, veclen to) {
+  if (from == to) {
+    auto none = vector<Value>();
+    return listOf(none);
+  }
+  if (list.type() == T_Pack)
+    return Value(Data{.ptr=pack(list)->slice(from, to)}, T_Pack);
+  auto v = vec(list)->drop(from).take(to - from);
+  return Value(Data{.ptr=new immer::flex_vector<Value>(v)}, T_Vec);
+}
+
+//Returns the items of finite lists joined as one list. Vectors are joined
+//  in O(log n) sharing structure, and packs of one type copied into one pack
+//  e.g. (concat list ...)
+Value EVM::o_Concat (Cell* a) {
+  auto lists = vector<Value>();
+  bool isPack = true;
+  for (; a; a = a->next) {
+    if (a->val.type() == T_N) continue;
+    Value list = finite(a->val);
+    if (list.type() == T_N) return Value();
+    if (!Lizt::length(list)) continue;
+    isPack = isPack && list.type() == T_Pack
+          && (lists.empty() || pack(list)->type == pack(lists[0])->type);
+    lists.push_back(list);
+  }
+  if (lists.size() < 2)
+    return lists.size() ? lists[0] : listOf(lists);
+  if (isPack) {
+    veclen len = 0;
+    for (auto &l : lists) len += pack(l)->len;
+    auto p = new Pack(pack(lists[0])->type, len);
+    veclen at = 0;
+    for (auto &l : lists) {
+      p->place(at, pack(l));
+      at += pack(l)->len;
+    }
+    return Value(Data{.ptr=p}, T_Pack);
+  }
+  Value first = boxed(lists[0]);
+  auto joined = *vec(first);
+  for (veclen i = 1, iLen = lists.size(); i < iLen; ++i) {
+    Value list = boxed(lists[i]);
+    joined = joined + *vec(list);
+  }
+  return Value(Data{.ptr=new immer::flex_vector<Value>(joined)}, T_Vec);
+}
+
+//Returns items [from, to) of a finite list, to defaulting to its length.
+//  Vectors are sliced in O(log n) sharing structure, and packs copied
+//  e.g. (subvec list from) (subvec list from to)
+Value EVM::o_Subvec (Cell* a) {
+  argnum n = numArgs(a);
+  if (n < 2) return Value();
+  Value list = finite(a->val);
+  if (list.type() == T_N) return Value();
+  int64_t len = Lizt::length(list);
+  int64_t from = toIndex(a->next->val), to = n > 2 ? toIndex(valAt(a, 2)) : len;
+  if (from < 0 || to < from || to > len) return Value();
+  return slice(list, from, to);
+}
+
+//Returns the first n items of a finite list and the rest, as two lists
+//  e.g. (split-at n list)
+Value EVM::o_SplitAt (Cell* a) {
+  if (numArgs(a) != 2) return Value();
+  Value list = finite(a->next->val);
+  int64_t at = toIndex(a->val);
+  if (list.type() == T_N || at < 0) return Value();
+  veclen len = Lizt::length(list);
+  at = min(at, (int64_t)len);
+  auto halves = vector<Value>{slice(list, 0, at), slice(list, at, len)};
+  return listOf(halves);
+}
+
+//Returns a view of the items of a finite list in reverse, without copying
+//  e.g. (reverse list)
+Value EVM::o_Reverse (Cell* a) {
+  if (!a) return Value();
+  Lizt* l = Lizt::list(a->val);
+  if (l->isInf()) {
+    delete l;
+    return Value();
+  }
+  return Value(Data{.ptr=Lizt::reverse(l)}, T_Lizt);
+}
+
+//Returns a Lizt of each size items of a list, step items apart,
+//  each a take of the list rather than a copy
+//  e.g. (window size list) (window size step list)
+Value EVM::o_Window (Cell* a) {
+  argnum n = numArgs(a);
+  if (n < 2) return Value();
+  veclen size = toLen(a->val), step = n > 2 ? toLen(a->next->val) : 1;
+  if (size < 1 || step < 1) return Value();
+  Lizt* l = Lizt::list(valAt(a, n - 1));
+  return Value(Data{.ptr=Lizt::window(l, size, step)}, T_Lizt);
+}
+
+//Returns a finite list as a T_Vec or T_Pack of at least len items,
+//  realizing any Lizt up front so that workers only index it
+Value EVM::realize (Value v, veclen len) {
+  if (isVec(v.type())) return v;
+  Lizt* l = Lizt::list(v);
+  l = Lizt::take(new Lizt::Take{l, 0, len});
+  Value list = liztFrom(l, 0);
+  delete l;
+  return list;
+}
+
+static atomic<uint32_t> liztTags {0};
+
+//Calls f over index ranges of [0, len) on the pool, with this EVM as
+//  worker 0 and copies of it for the others, merging their halts and fuel
+void EVM::parallel (veclen len, function<void(EVM&, veclen, veclen)> f) {
+  auto workers = vector<EVM>(Pool::size() - 1, *this);
+  uint64_t startFuel = fuel;
+  Heap* callerHeap = heap;
+  ++heap->shared;
+  Pool::run(len, [&](uint32_t w, veclen from, veclen to) {
+    heap = callerHeap;
+    liztTag = ++liztTags;
+    f(w ? workers[w - 1] : *this, from, to);
+  });
+  --heap->shared;
+  for (auto &vm : workers) {
+    uint64_t used = startFuel - vm.fuel;
+    fuel = fuel > used ? fuel - used : 0;
+    if (!halt) halt = vm.halt;
+  }
+  if (!fuel && !halt) halt = H_Fuel;
+}
+
+//Maps finite lists in parallel, as a T_Vec or T_Pack in order.
+//  Infinite lists are read up to the length of the shortest finite one.
+//  e.g. (pmap f v0 v1 ...)
+Value EVM::o_PMap (Cell* a) {
+  if (!isCallType(a) || !a->next) return Value();
+  veclen len = -1;
+  for (Cell* s = a->next; s; s = s->next) {
+    Lizt lizt = hcpy(Lizt::list(s->val));
+    if (!lizt.isInf() && (len == -1 || lizt.len < len))
+      len = lizt.len;
+  }
+  if (len == -1) return Value();
+  auto lists = vector<Value>();
+  for (Cell* s = a->next; s && !halt; s = s->next)
+    lists.push_back(realize(s->val, len));
+  auto items = vector<Value>(len);
+  parallel(len, [&](EVM &vm, veclen from, veclen to) {
+    for (veclen i = from; i < to && !vm.halt; ++i) {
+      Cell head = Cell{a->val}, *arg = &head;
+      for (auto &list : lists)
+        arg = arg->next = new Cell{vecAt(list, i)};
+      items[i] = vm.apply(&head);
+    }
+  });
+  return halt ? Value() : listOf(items);
+}
+
+//Filters a finite list in parallel, as a T_Vec or T_Pack in order.
+//  All items are tested, even when fewer are taken.
+//  An infinite list is filtered lazily, as with where
+//  e.g. (pwhere f list) (pwhere f take list) (pwhere f take skip list)
+Value EVM::o_PWhere (Cell* a) {
+  if (!isCallType(a)) return Value();
+  auto n = numArgs(a);
+  Lizt lizt = hcpy(Lizt::list(valAt(a, n - 1)));
+  if (lizt.isInf()) return o_Where(a);
+  veclen skipN = n == 4 ? max(toLen(valAt(a, 2)), (veclen)0) : 0;
+  veclen takeN = n >= 3 ? toLen(valAt(a, 1)) : lizt.len;
+  veclen len = max(lizt.len - skipN, (veclen)0);
+  Value list = realize(valAt(a, n - 1), lizt.len);
+  auto keep = vector<uint8_t>(len);
+  parallel(len, [&](EVM &vm, veclen from, veclen to) {
+    for (veclen i = from; i < to && !vm.halt; ++i) {
+      Cell head = Cell{a->val};
+      head.next = new Cell{vecAt(list, skipN + i)};
+      keep[i] = vm.apply(&head).tru();
+    }
+  });
+  if (halt) return Value();
+  auto kept = vector<Value>();
+  for (veclen i = 0; i < len && (veclen)kept.size() < takeN; ++i)
+    if (keep[i])
+      kept.push_back(vecAt(list, skipN + i));
+  return listOf(kept);
+}
+
+//Folds each range of a finite list in parallel, then folds the
+//  results in order, so f must be associative. (reduced x) has no effect.
+//  e.g. (preduce f list) (preduce f init list)
+Value EVM::o_PReduce (Cell* a) {
+  auto n = numArgs(a);
+  if (n < 2 || !isCallType(a)) return Value();
+  Lizt lizt = hcpy(Lizt::list(valAt(a, n - 1)));
+  if (lizt.isInf()) return Value();
+  Value list = realize(valAt(a, n - 1), lizt.len);
+  //Results by the index their range starts at
+  auto results = vector<Value>(lizt.len);
+  auto hasResult = vector<uint8_t>(lizt.len);
+  auto fold = [&](EVM &vm, Value acc, Value item) {
+    Cell head = Cell{a->val};
+    head.next = new Cell{acc};
+    head.next->next = new Cell{item};
+    return vm.apply(&head);
+  };
+  parallel(lizt.len, [&](EVM &vm, veclen from, veclen to) {
+    Value acc = vecAt(list, from);
+    for (veclen i = from + 1; i < to && !vm.halt; ++i)
+      acc = fold(vm, acc, vecAt(list, i));
+    vm.reduced = false;
+    results[from] = acc;
+    hasResult[from] = true;
+  });
+  Value acc;
+  bool hasAcc = n == 3;
+  if (hasAcc) acc = a->next->val;
+  for (veclen i = 0; i < lizt.len && !halt; ++i) {
+    if (!hasResult[i]) continue;
+    acc = hasAcc ? fold(*this, acc, results[i]) : results[i];
+    hasAcc = true;
+  }
+  reduced = false;
+  return halt ? Value() : acc;
+}
+
+
+//Sends a value to the isolate's outbox, realizing a finite Lizt first.
+//  Returns T if sent
+Value EVM::o_Send (Cell* a) {
+  if (!outbox || !a) return Value();
+  Value v = a->val;
+  if (v.type() == T_Lizt)
+    v = liztFrom(v.lizt(), 0);
+  a->val = Value(); //So that v can be moved if it was the only reference
+  outbox->send(v);
+  return Value(Data{.tru=true}, T_Bool);
+}
+
+//Waits for a value from the isolate's inbox, or N once it is closed
+Value EVM::o_Recv () {
+  Value v;
+  if (inbox) inbox->recv(v);
+  return v;
+}
+
+
+//Returns copies of parameter Cells, sharing their Values
+static Cell* copyParams (Cell* p) {
+  Cell* params = nullptr, **tail = &params;
+  for (; p; p = p->next) {
+    *tail = new Cell{p->val};
+    tail = &(*tail)->next;
+  }
+  return params;
+}
+
+Future::Future (EVM &parent, Value expr, Cell* p)
+  : vm(parent), form(Cell{expr}), params(copyParams(p)), owner(heap), startFuel(parent.fuel) {}
+
+//Called as the last Value is released. An unstarted future is cancelled
+void deleteFuture (Future* f) {
+  if (f->claim()) {
+    f->drop();
+    if (f->queued) --f->owner->futures;
+  }
+  f->drop();
+  f->unuse();
+}
+
+//Returns true if the caller is the one to run it
+bool Future::claim () {
+  uint8_t pending = 0;
+  return state.compare_exchange_strong(pending, 1);
+}
+
+void Future::run () {
+  Heap* prevHeap = heap;
+  uint32_t prevTag = liztTag;
+  heap = owner;
+  liztTag = ++liztTags;
+  value = vm.eval(&form, params);
+  form.val = Value();
+  delete params;
+  params = nullptr;
+  heap = prevHeap;
+  liztTag = prevTag;
+  {
+    lock_guard<mutex> l(lock);
+    state = 2;
+  }
+  done.notify_all();
+  bool wasQueued = queued;
+  Heap* h = owner;
+  drop();
+  if (wasQueued) --h->futures;
+}
 
+void Future::wait () {
+  unique_lock<mutex> l(lock);
+  done.wait(l, [&] { return state == 2; });
+}
+
+//Releases the owner's Values once neither the T_Future nor the
+//  evaluation holds them, while ARC is still atomic
+void Future::drop () {
+  if (--holds) return;
+  value = Value();
+  form.val = Value();
+  delete params;
+  params = nullptr;
+  vm.funcs = nullptr;
+  --owner->shared;
+}
+
+void Future::unuse () {
+  if (!--users) delete this;
+}
+
+//Waits for this EVM's futures still running on the pool
+void EVM::settle () {
+  while (heap->futures)
+    this_thread::yield();
+}
+
+//Schedules an expression on the pool, returning a T_Future to await.
+//  The parameters it uses are copied
+//  e.g. (future (where big? xs))
+Value EVM::o_Future (Cell* a, Cell* p) {
+  if (!a) return Value();
+  ++heap->shared;
+  //Lizts made until now may also be used by the future
+  liztTag = ++liztTags;
+  auto f = new Future(*this, a->val, p);
+  //Assume it's queued, as the task may run before submit returns
+  f->queued = true;
+  f->users = 2;
+  ++heap->futures;
+  bool queued = Pool::submit([f] {
+    if (f->claim()) f->run();
+    f->unuse();
+  });
+  if (!queued) {
+    f->queued = false;
+    f->users = 1;
+    --heap->futures;
+  }
+  return Value(Data{.ptr=f}, T_Future);
+}
+
+//Returns the value of a future, waiting for it, or evaluating it
+//  if no thread has started it. Other values are returned as they are
+Value EVM::o_Await (Cell* a) {
+  if (!a) return Value();
+  if (a->val.type() != T_Future) return a->val;
+  auto f = (Future*)a->val.ptr();
+  if (f->claim()) f->run();
+  else f->wait();
+  //Its fuel and halt are merged by the first to await it
+  if (!f->merged.exchange(true)) {
+    uint64_t used = f->startFuel - f->vm.fuel;
+    fuel = fuel > used ? fuel - used : 0;
+    if (!halt) halt = fuel ? f->vm.halt : H_Fuel;
+  }
+  return f->value;
+}
+
+
+Thunk::Thunk (Value expr, Cell* p) : form(Cell{expr}), params(copyParams(p)) {}
+
+Thunk::~Thunk () {
+  delete params;
+}
+
+void deleteThunk (Thunk* t) {
+  delete t;
+}
+
+//Returns a thunk of an expression, evaluated by the first to force it.
+//  The parameters it uses are copied
+//  e.g. (delay (sort big))
+Value EVM::o_Delay (Cell* a, Cell* p) {
+  if (!a) return Value();
+  return Value(Data{.ptr=new Thunk(a->val, p)}, T_Thunk);
+}
+
+//Returns the value of a thunk, evaluating it if no force has, after which
+//  its expression and parameters are released. An evaluation which halts
+//  is not kept. Other values are returned as they are
+Value EVM::o_Force (Cell* a) {
+  if (!a) return Value();
+  if (a->val.type() != T_Thunk) return a->val;
+  auto t = (Thunk*)a->val.ptr();
+  if (t->done) return t->value;
+  lock_guard<recursive_mutex> l(t->lock);
+  if (t->done) return t->value;
+  Value v = eval(&t->form, t->params);
+  if (halt) return Value();
+  t->value = v;
+  t->form.val = Value();
+  delete t->params;
+  t->params = nullptr;
+  t->done = true;
+  return v;
+}
+
+
+//Returns arguments as one string. A long string or T_Rope first is
+//  appended to as a T_Rope rather than copied
 Value EVM::o_Str (Cell* a) {
+  Type t = a ? a->val.type() : T_N;
+  if (t == T_Rope || (t == T_Str && ((string*)a->val.ptr())->size() >= ROPE_MIN)) {
+    string tail;
+    for (Cell* c = a->next; c; c = c->next)
+      tail += toStr(c->val);
+    if (t == T_Rope)
+      return Value(Data{.ptr=rope(a->val)->append(tail)}, T_Rope);
+    auto buf = make_shared<Rope::Buf>();
+    buf->data = *(string*)a->val.ptr() + tail;
+    return Value(Data{.ptr=new Rope{buf, buf->data.size()}}, T_Rope);
+  }
   auto str = new string();
   while (a) {
     *str += toStr(a->val);
@@ -373,12 +1697,20 @@ Value EVM::o_Print (Cell* a, bool nl) {
   Value v = o_Str(a);
   env.print(v.str().c_str());
   if (nl) env.print("\n");
-  else fflush(stdout);
+  else env.flush();
   return Value();
 }
 
 
 Value EVM::exeOp (Op op, Cell* a) {
+  //Ropes are read as strings by all but str and printing, and nth which
+  //  reads a rope in place
+  if (op != O_Str && op != O_Print && op != O_Prinln)
+    for (Cell* c = op == O_Nth && a ? a->next : a; c; c = c->next)
+      if (c->val.type() == T_Rope) c->val = flat(c->val);
+  if ((op == O_BA || op == O_BO || op == O_BXO || op == O_BN)
+   && a && (isVec(a->val.type()) || a->val.type() == T_Lizt))
+    return o_Bits(a, op);
   if (O_Add <= op && op <= O_BRS)
     return o_Math(a, op);
   if (O_Alike <= op && op <= O_LETo)
@@ -391,8 +1723,52 @@ Value EVM::exeOp (Op op, Cell* a) {
     case O_Range:  return o_Range(a);
     case O_Cycle:  return o_Cycle(a);
     case O_Emit:   return o_Emit(a);
+    case O_Iterate:return o_Gen(a, P_Iterate);
+    case O_Unfold: return o_Gen(a, P_Unfold);
     case O_Map:    return o_Map(a);
+    case O_Memo:   return o_Memo(a);
     case O_Where:  return o_Where(a);
+    case O_Reduce: return o_Reduce(a);
+    case O_Reduced:
+      reduced = true;
+      return a ? a->val : Value();
+    case O_Sort:   return o_Sort(a);
+    case O_SortBy: return o_SortBy(a);
+    case O_HashMap:return o_HashMap(a);
+    case O_HashSet:return o_HashSet(a);
+    case O_SortedMap: case O_SortedSet:
+                   return o_Sorted(a, op == O_SortedMap);
+    case O_Between:return o_Between(a);
+    case O_Get:    return o_Get(a);
+    case O_Assoc:  return o_Assoc(a);
+    case O_Nth:    return o_Nth(a);
+    case O_Conj:   return o_Conj(a);
+    case O_Into:   return o_Into(a);
+    case O_Concat: return o_Concat(a);
+    case O_Subvec: return o_Subvec(a);
+    case O_SplitAt:return o_SplitAt(a);
+    case O_Reverse:return o_Reverse(a);
+    case O_Window: return o_Window(a);
+    case O_Join:   return o_Join(a);
+    case O_Find:   return o_Find(a);
+    case O_Split:  return o_Split(a);
+    case O_Replace:return o_Replace(a);
+    case O_StartsWith: return o_StartsWith(a);
+    case O_Count:  return o_Count(a);
+    case O_Indices:return o_Indices(a);
+    case O_Record: return o_Record(a);
+    case O_Field:  return o_Field(a);
+    case O_Dissoc: return o_Dissoc(a);
+    case O_Contains: return o_Contains(a);
+    case O_Keys: case O_Vals:
+                   return o_Entries(a, op == O_Keys);
+    case O_PMap:   return o_PMap(a);
+    case O_PWhere: return o_PWhere(a);
+    case O_PReduce:return o_PReduce(a);
+    case O_Send:   return o_Send(a);
+    case O_Recv:   return o_Recv();
+    case O_Await:  return o_Await(a);
+    case O_Force:  return o_Force(a);
     case O_Str:    return o_Str(a);
     case O_Print: case O_Prinln:
                    return o_Print(a, op == O_Prinln);
@@ -417,7 +1793,7 @@ Value EVM::exeOp (Op op, Cell* a) {
 }
 
 Value EVM::eval (Cell* a, Cell* p) {
-  if (doRecur) return Value();
+  if (doRecur || halt) return Value();
   Type t = a->val.type();
   if (t == T_Cell) {
     //Evaluate all form arguments
@@ -440,6 +1816,10 @@ Value EVM::eval (Cell* a, Cell* p) {
             return Value{Data{.tru=false}, T_Bool};
         return Value{Data{.tru=true}, T_Bool};
       }
+      if (op == O_Future)
+        return o_Future(a->next, p);
+      if (op == O_Delay)
+        return o_Delay(a->next, p);
     }
     //Continue collecting arguments
     while ((a = a->next)) {
@@ -447,6 +1827,7 @@ Value EVM::eval (Cell* a, Cell* p) {
       arg->next = new Cell{eval(a, p)};
     }
     //... then call the operation/lambda/function
+    if (tick()) return Value();
     if (head.val.type() == T_Op) {
       if (op == O_Recur) {
         doRecur = true;
@@ -483,28 +1864,156 @@ string EVM::toStr (Value v) {
     case T_S32:  return to_string(v.s32());
     case T_D32:  return to_string(v.d32());
     case T_Bool: return v.tru() ? "T" : "F";
-    case T_Str:  return v.str();
-    case T_Vec: {
-      auto vect = *vec(v);
-      auto vLen = vect.size();
+    case T_Str: case T_Rope:
+                 return v.str();
+    case T_Vec: case T_Pack: {
+      auto vLen = Lizt::length(v);
       if (!vLen) return "[]";
-      string vecStr = toStr((Value)vect[0]);
-      for (uint i = 1; i < vLen; ++i)
-        vecStr += " " + toStr((Value)vect[i]);
+      string vecStr = toStr(vecAt(v, 0));
+      for (veclen i = 1; i < vLen; ++i)
+        vecStr += " " + toStr(vecAt(v, i));
       return "["+ vecStr +"]";
     }
-    case T_Lizt: return toStr(liztFrom(v.lizt(), 0)); break;
+    case T_Map: {
+      string mapStr;
+      for (auto &[key, val] : *hashMap(v))
+        mapStr += " " + toStr(key) + " " + toStr(val);
+      return "{"+ mapStr.substr(!mapStr.empty()) +"}";
+    }
+    case T_Set: {
+      string setStr;
+      for (auto &item : *hashSet(v))
+        setStr += " " + toStr(item);
+      return "#{"+ setStr.substr(!setStr.empty()) +"}";
+    }
+    case T_Rec: {
+      Record* r = record(v);
+      auto &fields = Layout::at(r->layout)->fields;
+      string str;
+      for (uint16_t f = 0; f < r->size; ++f)
+        str += " "+ fields[f] +" "+ toStr(r->fields()[f]);
+      return "#"+ Layout::at(r->layout)->name +"{"+ str.substr(!str.empty()) +"}";
+    }
+    case T_SMap: case T_SSet: {
+      string str;
+      sorted(v)->each([&](const Value &key, const Value &val) {
+        str += " " + toStr(key);
+        if (v.type() == T_SMap) str += " " + toStr(val);
+      });
+      return (v.type() == T_SMap ? "{" : "#{") + str.substr(!str.empty()) +"}";
+    }
+    case T_Lizt: {
+      Lizt* l = v.lizt();
+      if (l->isInf()) return "N";
+      if (Value v; mapKernel(l, v))
+        return toStr(v);
+      string lizStr;
+      Cursor c = cursor(l);
+      for (veclen i = 0; i < l->len && !halt; ++i)
+        lizStr += (i ? " " : "") + toStr(next(c));
+      return "["+ lizStr +"]";
+    }
     //TODO
   }
   return string("?");
 }
 
-//Returns next value of the lazy list
+//Vectorizes a finite map of a native arithmetic op over numeric vectors,
+//  or emits of a number, as a T_Pack.
+//  e.g. (map + v0 v1) (map * v 2)
+bool EVM::mapKernel (Lizt* l, Value &out) {
+  if (l->type != P_Map || l->isInf()) return false;
+  auto m = (Lizt::Map*)l->config;
+  Op op = m->head->val.op();
+  if (op < O_Add || op > O_BXO || m->sources.size() < 2) return false;
+  Type t, srcT;
+  vector<uint32_t> acc, buf;
+  auto first = gatherNums(m->sources[0], t, buf);
+  if (!first) return false;
+  acc.assign(first, first + l->len);
+  bool isFloat = t == T_D32;
+  for (argnum v = 1, vLen = m->sources.size(); v < vLen; ++v) {
+    Lizt* s = m->sources[v];
+    bool isScalar = s->type == P_Emit;
+    const uint32_t* src;
+    uint32_t scalar;
+    if (isScalar) {
+      Value e = *(Value*)s->config;
+      srcT = e.type();
+      if (srcT < T_U08 || srcT > T_D32) return false;
+      scalar = isFloat ? e.u32() : e.u32c();
+      src = &scalar;
+    } else if (!(src = gatherNums(s, srcT, buf))) return false;
+    //Integer ops convert between integer types, but not floats
+    if (isFloat != (srcT == T_D32)) return false;
+    if (!Kernel::math(op, isFloat, acc.data(), src, isScalar, acc.data(), l->len))
+      return false;
+  }
+  out = numsToPack(acc.data(), l->len, t);
+  return true;
+}
+
+//Vectorizes a finite where of a comparison between the parameter
+//  and a number over a numeric vector, as a T_Pack.
+//  e.g. (where #(< % 10) v) (where #(= 3 %) v)
+bool EVM::whereKernel (Cell* a, Lizt* l, veclen skipN, veclen takeN, Value &out) {
+  if (a->val.type() != T_Lamb) return false;
+  Cell* f = a->val.cell();
+  Op op = f->val.op();
+  if (op < O_Alike || op > O_LETo || numArgs(f) != 3) return false;
+  bool swapped = f->next->next->val.type() == T_Para;
+  Value para = (swapped ? f->next->next : f->next)->val;
+  Value lit  = (swapped ? f->next : f->next->next)->val;
+  if (para.type() != T_Para || para.u08() || lit.type() < T_U08 || lit.type() > T_D32)
+    return false;
+  Type t;
+  vector<uint32_t> buf;
+  const uint32_t* items;
+  if (skipN < 0 || skipN >= l->len || !(items = gatherNums(l, t, buf))) return false;
+  //Floats are only alike with floats
+  if ((op == O_Alike || op == O_NAlike)
+   && (t == T_D32 || lit.type() == T_D32) && t != lit.type())
+    return false;
+  uint32_t c = lit.u32();
+  if (op > O_NEqual) {
+    float d = lit.d32c();
+    memcpy(&c, &d, 4);
+  }
+  veclen len = l->len - skipN;
+  auto keep = vector<uint8_t>(len);
+  if (!Kernel::mask(op, t == T_D32, items + skipN, c, swapped, keep.data(), len))
+    return false;
+  auto kept = vector<uint32_t>();
+  for (veclen i = 0; i < len && (veclen)kept.size() < takeN; ++i)
+    if (keep[i])
+      kept.push_back(items[skipN + i]);
+  out = numsToPack(kept.data(), kept.size(), t);
+  return true;
+}
+
+//Evaluates a head Cell, and its following argument Cells, as a form
+Value EVM::apply (Cell* head) {
+  Cell form = Cell{Value(Data{.cell=head}, T_Cell)};
+  Value v = eval(&form);
+  form.val.kill(); //Ensure head is not destroyed with form
+  return v;
+}
+
+//Serializes use of a Lizt with state mutated per item, such as its
+//  argument Cells, if made outside of this thread's parallel task
+static recursive_mutex lazyLock;
+static unique_lock<recursive_mutex> guard (Lizt* l) {
+  if (!heap->shared || l->tag == liztTag) return {};
+  return unique_lock<recursive_mutex>(lazyLock);
+}
+
+//Returns an item of the lazy list by index
 Value EVM::liztAt (Lizt* l, veclen at) {
+  if (tick()) return Value();
   switch (l->type) {
     case LiztT::P_Vec: {
-      auto list = (vector<Value>*)l->config;
-      return list->at(at);
+      Value &v = *(Value*)l->config;
+      return at >= 0 && at < Lizt::length(v) ? vecAt(v, at) : Value();
     }
     case LiztT::P_Take: {
       auto t = (Lizt::Take*)l->config;
@@ -512,39 +2021,161 @@ Value EVM::liztAt (Lizt* l, veclen at) {
     }
     case LiztT::P_Range: {
       auto r = (Lizt::Range*)l->config;
-      int32_t n = r->from == r->to ? at : r->from + (at * r->step);
-      return Value(Data{.s32=n}, T_S32);
+      return Value(Data{.s32=(int32_t)(r->from + at * r->step)}, T_S32);
     }
     case LiztT::P_Cycle: {
       auto c = (vector<Value>*)l->config;
-      return c->at(at % c->size());
+      return c->empty() ? Value() : c->at(at % c->size());
     }
     case LiztT::P_Emit:
       return *(Value*)l->config;
+    case LiztT::P_Span: {
+      auto s = (Lizt::Span*)l->config;
+      auto [key, val] = sorted(s->coll)->at(s->from + at);
+      if (s->coll.type() == T_SSet) return key;
+      auto pair = vector<Value>{key, val};
+      return listOf(pair);
+    }
+    case LiztT::P_Str: {
+      auto str = (string*)((Value*)l->config)->ptr();
+      return Value(Data{.s08=(*str)[at]}, T_S08);
+    }
+    case LiztT::P_Reverse:
+      return liztAt((Lizt*)l->config, l->len - 1 - at);
+    case LiztT::P_Window: {
+      auto w = (Lizt::Window*)l->config;
+      auto take = new Lizt::Take{new Lizt(*w->lizt), at * w->step, w->size};
+      return Value(Data{.ptr=Lizt::take(take)}, T_Lizt);
+    }
     case LiztT::P_Map: {
       auto m = (Lizt::Map*)l->config;
-      Cell args = Cell{liztAt(m->sources[0], at)}, *arg = &args;
-      for (argnum v = 1, vLen = m->sources.size(); v < vLen; ++v) {
-        arg = arg->next ? arg->next : arg;
-        arg->next = new Cell{liztAt(m->sources[v], at)};
+      auto g = guard(l);
+      Cell* arg = m->head;
+      for (auto source : m->sources)
+        (arg = arg->next)->val = liztAt(source, at);
+      return eval(&m->call);
+    }
+    case LiztT::P_Iterate: case LiztT::P_Unfold: {
+      Cursor c = cursor(l, at);
+      return next(c);
+    }
+    case LiztT::P_Memo: {
+      auto m = (Lizt::Memo*)l->config;
+      auto g = guard(l);
+      veclen n = at / MEMO_CHUNK;
+      if (n >= (veclen)m->chunks.size())
+        m->chunks.resize(n + 1);
+      if (!m->chunks[n]) {
+        //Realize the whole chunk sequentially
+        veclen from = n * MEMO_CHUNK, to = from + MEMO_CHUNK;
+        if (!l->isInf() && to > l->len) to = l->len;
+        auto chunk = new vector<Value>();
+        Cursor c = cursor(m->lizt, from);
+        for (veclen i = from; i < to; ++i)
+          chunk->push_back(next(c));
+        if (halt) {
+          delete chunk; //Incomplete
+          return Value();
+        }
+        m->chunks[n] = chunk;
+      }
+      return m->chunks[n]->at(at % MEMO_CHUNK);
+    }
+    case LiztT::P_Where: {
+      auto w = (Lizt::Where*)l->config;
+      auto g = guard(l);
+      if (!w->scan)
+        w->scan = new Cursor(cursor(w->lizt));
+      //Test source items until the requested match is found
+      while ((veclen)w->matches.size() <= at && !halt) {
+        Value testVal = next(*w->scan);
+        w->head->next->val = testVal;
+        if (apply(w->head).tru())
+          w->matches.push_back(testVal);
       }
-      m->head->next = &args;
-      //Create a temporary form Cell
-      Cell form = Cell{Value(Data{.cell=m->head}, T_Cell)};
-      Value v = eval(&form);
-      form.val.kill(); //Ensure head is not destroyed with form
-      m->head->next = nullptr;
-      return v;
+      return halt ? Value() : w->matches[at];
     }
   }
   return Value();
 }
 
-//Returns remaining Lizt items as T_Vec
+//Returns a cursor positioned at an item of the lazy list
+Cursor EVM::cursor (Lizt* l, veclen from) {
+  Cursor c = Cursor{l, from};
+  switch (l->type) {
+    case LiztT::P_Take: {
+      auto t = (Lizt::Take*)l->config;
+      c.sources.push_back(cursor(t->lizt, t->skip + from));
+      break;
+    }
+    case LiztT::P_Map:
+      for (auto source : ((Lizt::Map*)l->config)->sources)
+        c.sources.push_back(cursor(source, from));
+      break;
+    case LiztT::P_Iterate: case LiztT::P_Unfold:
+      c.at = 0;
+      c.state = ((Lizt::Gen*)l->config)->seed;
+      while (c.at < from && !halt)
+        next(c);
+      break;
+  }
+  return c;
+}
+
+//Returns the item at the cursor and advances it
+Value EVM::next (Cursor& c) {
+  Lizt* l = c.lizt;
+  switch (l->type) {
+    case LiztT::P_Take:
+      ++c.at;
+      return next(c.sources[0]);
+    case LiztT::P_Map: {
+      if (tick()) return Value();
+      auto m = (Lizt::Map*)l->config;
+      auto g = guard(l);
+      Cell* arg = m->head;
+      for (auto& source : c.sources)
+        (arg = arg->next)->val = next(source);
+      ++c.at;
+      return eval(&m->call);
+    }
+    case LiztT::P_Iterate: {
+      if (tick()) return Value();
+      auto g = (Lizt::Gen*)l->config;
+      if (c.at++) {
+        auto lock = guard(l);
+        g->head->next->val = c.state;
+        c.state = apply(g->head);
+      }
+      return c.state;
+    }
+    case LiztT::P_Unfold: {
+      if (tick()) return Value();
+      auto g = (Lizt::Gen*)l->config;
+      auto lock = guard(l);
+      g->head->next->val = c.state;
+      Value pair = apply(g->head);
+      ++c.at;
+      if (!isVec(pair.type()) || Lizt::length(pair) < 2) {
+        c.state = Value();
+        return Value();
+      }
+      c.state = vecAt(pair, 1);
+      return vecAt(pair, 0);
+    }
+  }
+  return liztAt(l, c.at++);
+}
+
+//Returns remaining Lizt items as T_Vec or T_Pack
 Value EVM::liztFrom (Lizt* l, veclen from) {
   if (l->isInf()) return Value();
-  auto list = immer::vector_transient<Value>();
-  for (auto i = from; i < l->len; ++i)
-    list.push_back(liztAt(l, i));
-  return Value(Data{.ptr=new immer::vector<Value>(list.persistent())}, T_Vec);
+  if (Value v; !from && mapKernel(l, v))
+    return v;
+  auto list = vector<Value>();
+  list.reserve(l->len - from);
+  Cursor c = cursor(l, from);
+  for (auto i = from; i < l->len && !halt; ++i)
+    list.push_back(next(c));
+  return listOf(list);
 }
\ No newline at end of file
@@ -1,8 +1,14 @@
 #pragma once
 #include <memory>
 #include <string>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include "Env.hpp"
 #include "Cell.hpp"
+#include "Channel.hpp"
 using namespace std;
 
 class FuncList {
@@ -19,6 +25,7 @@ public:
 };
 
 class EVM {
+  friend struct Future;
 public:
   EVM (Env e) { env = e; }
 
@@ -26,19 +33,35 @@ public:
   void removeFunc (fid);
   Value exeFunc (fid, Cell* = nullptr);
   string toStr (Value);
+  void  setLimits (uint64_t fuel = 0, uint32_t ms = 0, uint32_t depth = 0);
+  Halt  halted () { return halt; }
+  void  connect (Channel* in, Channel* out) { inbox = in; outbox = out; }
+  void  settle ();
 
 private:
   Env env;
-  FuncList funcs = FuncList();
+  shared_ptr<FuncList> funcs = make_shared<FuncList>(); //Shared with workers
+  Channel* inbox = nullptr, *outbox = nullptr; //Of an isolate
   bool doRecur = false;
   Cell* recurArgs = nullptr;
   Cell* recurGarbage = nullptr;
+  bool reduced = false; //Set by (reduced x) to end a reduce early
+  //Evaluation limits; fuel counts calls and Lizt items
+  Halt halt = H_None;
+  uint64_t fuel = UINT64_MAX;
+  uint32_t depth = 0, maxDepth = 0;
+  bool hasDeadline = false;
+  chrono::steady_clock::time_point deadline;
+
+  bool  tick ();
+  bool  checkLimits ();
 
   Value exeOp (Op, Cell*);
   Value eval (Cell*, Cell* = nullptr);
   Value valAt (Cell*, argnum);
   Cell* cellAt (Cell*, argnum);
-  bool  areAlike (Value, Value);
+  bool  areAlike  (Value, Value);
+  bool  vecsAlike (Value&, Value&);
   Value o_Math   (Cell*, Op);
   Value o_Equal  (Cell*, Op);
   Value o_Vec    (Cell*);
@@ -47,10 +70,99 @@ private:
   Value o_Range  (Cell*);
   Value o_Cycle  (Cell*);
   Value o_Emit   (Cell*);
+  Value o_Gen    (Cell*, LiztT);
   Value o_Map    (Cell*);
+  Value o_Memo   (Cell*);
   Value o_Where  (Cell*);
+  Value o_Reduce (Cell*);
+  Value o_Sort   (Cell*);
+  Value o_SortBy (Cell*);
+  Value keyOf     (Value);
+  Value o_HashMap (Cell*);
+  Value o_HashSet (Cell*);
+  Value o_Sorted  (Cell*, bool);
+  Value o_Between (Cell*);
+  Value o_Get     (Cell*);
+  Value o_Assoc   (Cell*);
+  Value o_Dissoc  (Cell*);
+  Value o_Contains(Cell*);
+  Value o_Entries (Cell*, bool);
+  Value nth       (Value, Value, Value);
+  Value append    (Value, vector<Value>&, bool);
+  Value o_Nth     (Cell*);
+  Value o_Conj    (Cell*);
+  Value o_Into    (Cell*);
+  Value finite    (Value);
+  Value o_Concat  (Cell*);
+  Value o_Subvec  (Cell*);
+  Value o_SplitAt (Cell*);
+  Value o_Reverse (Cell*);
+  Value o_Window  (Cell*);
+  Value o_Join    (Cell*);
+  Value o_Find    (Cell*);
+  Value o_Split   (Cell*);
+  Value o_Replace (Cell*);
+  Value o_StartsWith (Cell*);
+  Value o_Bits    (Cell*, Op);
+  Value o_Count   (Cell*);
+  Value o_Indices (Cell*);
+  Value o_Record  (Cell*);
+  Value o_Field   (Cell*);
+  Value o_PMap    (Cell*);
+  Value o_PWhere  (Cell*);
+  Value o_PReduce (Cell*);
+  Value o_Send   (Cell*);
+  Value o_Recv   ();
+  Value o_Future (Cell*, Cell*);
+  Value o_Await  (Cell*);
+  Value o_Delay  (Cell*, Cell*);
+  Value o_Force  (Cell*);
   Value o_Str    (Cell*);
   Value o_Print  (Cell*, bool);
+  Value apply    (Cell*);
+  void  parallel (veclen, function<void(EVM&, veclen, veclen)>);
+  Value realize  (Value, veclen);
+  bool  mapKernel   (Lizt*, Value&);
+  bool  whereKernel (Cell*, Lizt*, veclen, veclen, Value&);
   Value liztAt   (Lizt*, veclen);
   Value liztFrom (Lizt*, veclen);
-};
\ No newline at end of file
+  Cursor cursor  (Lizt*, veclen = 0);
+  Value next     (Cursor&);
+};
+
+//An expression evaluated on the pool by a copy of an EVM,
+//  or by the first to await it if no thread has started it
+struct Future {
+  EVM   vm;
+  Cell  form;   //Shares the expression
+  Cell* params; //Copies of the parameters
+  Value value;
+  Heap* owner;
+  uint64_t startFuel;
+  atomic<uint8_t> state {0}; //Pending, running, done
+  atomic<uint8_t> holds {2}; //By the T_Future and the evaluation, of owner's Values
+  atomic<uint8_t> users {1}; //By the T_Future and a queued pool task, of this
+  atomic<bool> merged {false};
+  bool queued = false;       //On the pool, so counted in owner's futures
+  mutex lock;
+  condition_variable done;
+
+  Future (EVM&, Value, Cell*);
+  bool claim ();
+  void run   ();
+  void wait  ();
+  void drop  ();
+  void unuse ();
+};
+
+//An expression evaluated at most once, by the first to force it
+struct Thunk {
+  Cell  form;   //Shares the expression until it is evaluated
+  Cell* params; //Copies of the parameters
+  Value value;
+  atomic<bool> done {false};
+  recursive_mutex lock;
+
+  Thunk (Value, Cell*);
+  ~Thunk ();
+};
@@ -4,38 +4,59 @@
 
 typedef size_t   fid;    //Func ID/hash
 typedef uint8_t  argnum; //Parameter number
-typedef int32_t  veclen; //Vec or Lizt len
+typedef int64_t  veclen; //Vec or Lizt len or index
 typedef uint16_t refnum; //ARC reference number
 
 const refnum NUM_OBJ = 20'000;
+const uint16_t MAX_HEAPS = 256;
+const veclen MEMO_CHUNK = 32; //Items realized at once by a memo Lizt
+const size_t ROPE_MIN = 256;  //Length from which str appends to a string as a Rope
+const uint16_t MAX_LAYOUTS = 4096; //Record types declared by defrecord
+
+//Reason an evaluation was interrupted
+enum Halt : uint8_t {
+  H_None, H_Fuel, H_Time, H_Depth
+};
 
 enum Type : uint8_t {
   T_N, T_Op, T_Cell, T_Var, T_Bind,
   T_Lamb, T_Func, T_Para,
   T_U08, T_S08, T_U32, T_S32, T_D32,
-  T_Bool, T_Str, T_Vec, T_Lizt
+  T_Bool, T_Str, T_Vec, T_Lizt, T_Pack, T_Future, T_Map, T_Set, T_SMap, T_SSet, T_Rope, T_Rec, T_Thunk
 };
 
 enum Op : uint8_t {
-  O_None, O_If, O_Not, O_Recur, O_Or, O_And,
+  O_None, O_If, O_Not, O_Recur, O_Or, O_And, O_Future, O_Delay,
   O_Add, O_Sub, O_Mul, O_Div, O_Mod, O_Pow,
   O_BA, O_BO, O_BXO, O_BLS, O_BRS, O_BN,
   O_Alike, O_NAlike, O_Equal, O_NEqual,
   O_GThan, O_LThan, O_GETo, O_LETo,
   O_Vec, O_Skip, O_Take, O_Range, O_Cycle, O_Emit,
-  O_Map, O_Where, O_Reduce,
+  O_Iterate, O_Unfold, O_Map, O_Memo, O_Where, O_Reduce, O_Reduced,
+  O_Sort, O_SortBy,
+  O_HashMap, O_HashSet, O_SortedMap, O_SortedSet, O_Between, O_Get, O_Assoc, O_Dissoc, O_Contains, O_Keys, O_Vals,
+  O_Nth, O_Conj, O_Into, O_Concat, O_Subvec, O_SplitAt, O_Reverse, O_Window,
+  O_Join, O_Find, O_Split, O_Replace, O_StartsWith, O_Count, O_Indices,
+  O_Record, O_Field,
+  O_PMap, O_PWhere, O_PReduce, O_Send, O_Recv, O_Await, O_Force,
   O_Str, O_Val, O_Do,
   O_Print, O_Prinln, O_RKey, O_RStr, O_Sleep
 };
 
 const char* const ops[] = {
-  "none", "if", "not", "recur", "or", "and",
+  "none", "if", "not", "recur", "or", "and", "future", "delay",
   "+", "-", "*", "/", "mod", "**",
   "&", "|", "^", "<<", ">>", "~",
   "=", "!=", "==", "!==",
   "<", ">", "<=", ">=",
   "vec", "skip", "take", "range", "cycle", "emit",
-  "map", "where", "reduce",
+  "iterate", "unfold", "map", "memo", "where", "reduce", "reduced",
+  "sort", "sort-by",
+  "hash-map", "hash-set", "sorted-map", "sorted-set", "between", "get", "assoc", "dissoc", "contains?", "keys", "vals",
+  "nth", "conj", "into", "concat", "subvec", "split-at", "reverse", "window",
+  "join", "find", "split", "replace", "starts-with?", "count", "indices",
+  "record", "field",
+  "pmap", "pwhere", "preduce", "send", "recv", "await", "force",
   "str", "val", "do",
   "print", "println", "get-key", "get-str", "sleep",
   0
@@ -6,7 +6,16 @@
 #include "linenoise/linenoise.h"
 
 void Env::print (const char* str) {
-  printf("%s", str);
+  if (!out) printf("%s", str);
+  else if (!outLock) *out += str;
+  else {
+    lock_guard<mutex> l(*outLock);
+    *out += str;
+  }
+}
+
+void Env::flush () {
+  if (!out) fflush(stdout);
 }
 
 char Env::getKey () {
@@ -1,9 +1,14 @@
 #pragma once
+#include <mutex>
 #include <string>
 using namespace std;
 
 struct Env {
-  static void    print (const char*);
+  string* out = nullptr; //Output is collected here if set, else printed
+  mutex* outLock = nullptr; //Held while appending to out, shared by workers
+
+  void           print (const char*);
+  void           flush ();
   static char    getKey ();
   static string* getString (string);
   static void    sleep  (uint);
@@ -0,0 +1,35 @@
+#include "Isolate.hpp"
+#include "Parser.hpp"
+
+Isolate::Isolate (string src) : vm(EVM(Env{&output, &outputLock})), source(src) {}
+
+Isolate::~Isolate () {
+  join();
+}
+
+void Isolate::start (uint64_t fuel, uint32_t ms, uint32_t depth, bool withStr) {
+  vm.connect(inbox.get(), outbox.get());
+  runner = thread(&Isolate::run, this, fuel, ms, depth, withStr);
+}
+
+void Isolate::join () {
+  if (runner.joinable())
+    runner.join();
+}
+
+void Isolate::run (uint64_t fuel, uint32_t ms, uint32_t depth, bool withStr) {
+  if (ownHeap.full) {
+    output = "Out of heaps.\n";
+    outbox->close();
+    return;
+  }
+  heap = &ownHeap;
+  for (auto func : Parser::parse(source))
+    vm.addFunc(func.first, func.second);
+  vm.setLimits(fuel, ms, depth);
+  result = vm.exeFunc(0);
+  if (withStr) resultStr = vm.toStr(result);
+  vm.settle();
+  outbox->close();
+}
+
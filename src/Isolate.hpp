@@ -0,0 +1,33 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <thread>
+#include "Channel.hpp"
+#include "EVM.hpp"
+using namespace std;
+
+//An EVM with its own heap, evaluating a script on its own thread.
+//  (recv) takes from its inbox and (send x) puts into its outbox,
+//  which is closed once the script ends. It doesn't run if no heap
+//  is free
+class Isolate {
+  Heap   ownHeap; //Declared first so that it outlives the Values below
+  EVM    vm;
+  string source;
+  thread runner;
+  void   run (uint64_t fuel, uint32_t ms, uint32_t depth, bool withStr);
+
+public:
+  shared_ptr<Channel> inbox  = make_shared<Channel>();
+  shared_ptr<Channel> outbox = make_shared<Channel>();
+  string output; //Printed by the script
+  mutex  outputLock;
+  Value  result;
+  string resultStr; //If started with it, made under the limits
+
+  Isolate (string);
+  ~Isolate ();
+  void   start (uint64_t fuel = 0, uint32_t ms = 0, uint32_t depth = 0, bool withStr = false);
+  void   join  ();
+  Halt   halted () { return vm.halted(); }
+};
@@ -0,0 +1,265 @@
+#include "Kernels.hpp"
+#include <cstring>
+#include <type_traits>
+using namespace std;
+
+//GCC vector extensions: 8 lanes, split into two halves without AVX2
+typedef uint32_t vu32 __attribute__((vector_size(32)));
+typedef int32_t  vs32 __attribute__((vector_size(32)));
+typedef float    vd32 __attribute__((vector_size(32)));
+typedef uint8_t  vu08 __attribute__((vector_size(32)));
+typedef int8_t   vs08 __attribute__((vector_size(32)));
+const veclen LANES = 8;
+
+#define INLINE __attribute__((always_inline)) inline
+
+//Vectors are passed by reference as their ABI differs with AVX2
+template <class V>
+INLINE void load (V &v, const uint32_t* p) {
+  memcpy(&v, p, sizeof(V));
+}
+
+template <class V>
+INLINE void store (uint32_t* p, const V &v) {
+  memcpy(p, &v, sizeof(V));
+}
+
+//x = x op y, lane-wise or for one number
+template <class T>
+INLINE void apply (Op op, T &x, const T &y) {
+  switch (op) {
+    case O_Add: x += y; break;
+    case O_Sub: x -= y; break;
+    case O_Mul: x *= y; break;
+    case O_Div: x /= y; break;
+  }
+  if constexpr (!is_same<T, vd32>::value && !is_same<T, float>::value)
+    switch (op) {
+      case O_BA:  x &= y; break;
+      case O_BO:  x |= y; break;
+      case O_BXO: x ^= y; break;
+    }
+}
+
+//Applies op lane-wise, then to the remainder one at a time
+template <class V, class T>
+INLINE void zip (Op op, const uint32_t* a, const uint32_t* b, bool bScalar,
+                 uint32_t* out, veclen len) {
+  T s;
+  memcpy(&s, b, 4);
+  V sv = V{} + s;
+  veclen i = 0;
+  for (; i + LANES <= len; i += LANES) {
+    V x, y = sv;
+    load(x, a + i);
+    if (!bScalar) load(y, b + i);
+    apply(op, x, y);
+    store(out + i, x);
+  }
+  for (; i < len; ++i) {
+    T x, y;
+    memcpy(&x, a + i, 4);
+    memcpy(&y, bScalar ? b : b + i, 4);
+    apply(op, x, y);
+    memcpy(out + i, &x, 4);
+  }
+}
+
+INLINE bool mathImpl (Op op, bool isFloat, const uint32_t* a, const uint32_t* b,
+                      bool bScalar, uint32_t* out, veclen len) {
+  if (isFloat) {
+    if (op < O_Add || op > O_Div) return false;
+    zip<vd32, float>(op, a, b, bScalar, out, len);
+  } else {
+    if (op < O_Add || op > O_BXO || op == O_Div || op == O_Mod || op == O_Pow)
+      return false;
+    zip<vu32, uint32_t>(op, a, b, bScalar, out, len);
+  }
+  return true;
+}
+
+//Compares lanes as floats, converting from signed integers if needed
+INLINE void compare (bool isFloat, const uint32_t* a, float c, bool less,
+                     uint8_t* keep, veclen len) {
+  vd32 cv = vd32{} + c;
+  veclen i = 0;
+  for (; i + LANES <= len; i += LANES) {
+    vd32 x;
+    vs32 n;
+    if (isFloat) load(x, a + i);
+    else {
+      load(n, a + i);
+      x = __builtin_convertvector(n, vd32);
+    }
+    vs32 m = less ? x < cv : x > cv;
+    for (veclen l = 0; l < LANES; ++l)
+      keep[i + l] = m[l] & 1;
+  }
+  for (; i < len; ++i) {
+    float x;
+    if (isFloat) memcpy(&x, a + i, 4);
+    else x = (float)(int32_t)a[i];
+    keep[i] = less ? x < c : x > c;
+  }
+}
+
+INLINE bool maskImpl (Op op, bool isFloat, const uint32_t* a, uint32_t c,
+                      bool swapped, uint8_t* keep, veclen len) {
+  //Equality of bits
+  if (O_Alike <= op && op <= O_NEqual) {
+    bool eq = op == O_Alike || op == O_Equal;
+    vu32 cv = vu32{} + c;
+    veclen i = 0;
+    for (; i + LANES <= len; i += LANES) {
+      vu32 x;
+      load(x, a + i);
+      vs32 m = x == cv;
+      for (veclen l = 0; l < LANES; ++l)
+        keep[i + l] = (m[l] & 1) == eq;
+    }
+    for (; i < len; ++i)
+      keep[i] = (a[i] == c) == eq;
+    return true;
+  }
+  float cf;
+  memcpy(&cf, &c, 4);
+  //Ops are the first argument compared with the second,
+  //  and <= >= are the negation of > <, as with numDiff
+  bool less = (op == O_GThan || op == O_LETo) ^ swapped;
+  bool neg  = op == O_GETo || op == O_LETo;
+  switch (op) {
+    case O_GThan: case O_LThan: case O_GETo: case O_LETo:
+      compare(isFloat, a, cf, less, keep, len);
+      if (neg)
+        for (veclen i = 0; i < len; ++i)
+          keep[i] = !keep[i];
+      return true;
+  }
+  return false;
+}
+
+INLINE void foldOne (Op op, uint32_t &acc, uint32_t x) {
+  switch (op) {
+    case O_Add: acc += x; break;
+    case O_Mul: acc *= x; break;
+    case O_BA:  acc &= x; break;
+    case O_BO:  acc |= x; break;
+    case O_BXO: acc ^= x; break;
+  }
+}
+
+//Integer folds are associative and commutative so lanes fold separately
+INLINE bool foldImpl (Op op, const uint32_t* a, veclen len, uint32_t &acc) {
+  uint32_t unit;
+  switch (op) {
+    case O_Add: case O_BO: case O_BXO: unit = 0; break;
+    case O_Mul: unit = 1; break;
+    case O_BA:  unit = ~0u; break;
+    default: return false;
+  }
+  vu32 v = vu32{} + unit;
+  veclen i = 0;
+  for (; i + LANES <= len; i += LANES) {
+    vu32 x;
+    load(x, a + i);
+    switch (op) {
+      case O_Add: v += x; break;
+      case O_Mul: v *= x; break;
+      case O_BA:  v &= x; break;
+      case O_BO:  v |= x; break;
+      case O_BXO: v ^= x; break;
+    }
+  }
+  for (; i < len; ++i)
+    foldOne(op, acc, a[i]);
+  for (veclen l = 0; l < LANES; ++l)
+    foldOne(op, acc, v[l]);
+  return true;
+}
+
+
+//Tests 32 candidate positions at once: those whose first and last bytes
+//  match the needle's are then compared in full
+INLINE veclen findImpl (const char* hay, veclen len, const char* needle, veclen nLen) {
+  if (!nLen) return 0;
+  veclen end = len - nLen + 1; //Past the last candidate
+  vu08 first = vu08{} + (uint8_t)needle[0], last = vu08{} + (uint8_t)needle[nLen - 1];
+  veclen i = 0;
+  for (; i + 32 <= end; i += 32) {
+    vu08 a, b;
+    memcpy(&a, hay + i, 32);
+    memcpy(&b, hay + i + nLen - 1, 32);
+    vs08 m = (a == first) & (b == last);
+    uint64_t any[4];
+    memcpy(any, &m, 32);
+    if (!(any[0] | any[1] | any[2] | any[3])) continue;
+    for (veclen l = 0; l < 32; ++l)
+      if (m[l] && !memcmp(hay + i + l, needle, nLen))
+        return i + l;
+  }
+  for (; i < end; ++i)
+    if (hay[i] == needle[0] && !memcmp(hay + i, needle, nLen))
+      return i;
+  return -1;
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AVX2 __attribute__((target("avx2")))
+static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+#else
+#define AVX2
+static const bool hasAVX2 = false;
+#endif
+
+AVX2 static bool mathAVX2 (Op op, bool f, const uint32_t* a, const uint32_t* b,
+                           bool s, uint32_t* out, veclen len) {
+  return mathImpl(op, f, a, b, s, out, len);
+}
+static bool mathBase (Op op, bool f, const uint32_t* a, const uint32_t* b,
+                      bool s, uint32_t* out, veclen len) {
+  return mathImpl(op, f, a, b, s, out, len);
+}
+AVX2 static bool maskAVX2 (Op op, bool f, const uint32_t* a, uint32_t c,
+                           bool s, uint8_t* keep, veclen len) {
+  return maskImpl(op, f, a, c, s, keep, len);
+}
+static bool maskBase (Op op, bool f, const uint32_t* a, uint32_t c,
+                      bool s, uint8_t* keep, veclen len) {
+  return maskImpl(op, f, a, c, s, keep, len);
+}
+AVX2 static bool foldAVX2 (Op op, const uint32_t* a, veclen len, uint32_t &acc) {
+  return foldImpl(op, a, len, acc);
+}
+static bool foldBase (Op op, const uint32_t* a, veclen len, uint32_t &acc) {
+  return foldImpl(op, a, len, acc);
+}
+AVX2 static veclen findAVX2 (const char* h, veclen len, const char* n, veclen nLen) {
+  return findImpl(h, len, n, nLen);
+}
+static veclen findBase (const char* h, veclen len, const char* n, veclen nLen) {
+  return findImpl(h, len, n, nLen);
+}
+
+
+bool Kernel::math (Op op, bool isFloat, const uint32_t* a, const uint32_t* b,
+                   bool bScalar, uint32_t* out, veclen len) {
+  return hasAVX2 ? mathAVX2(op, isFloat, a, b, bScalar, out, len)
+                 : mathBase(op, isFloat, a, b, bScalar, out, len);
+}
+
+bool Kernel::mask (Op op, bool isFloat, const uint32_t* a, uint32_t c,
+                   bool swapped, uint8_t* keep, veclen len) {
+  return hasAVX2 ? maskAVX2(op, isFloat, a, c, swapped, keep, len)
+                 : maskBase(op, isFloat, a, c, swapped, keep, len);
+}
+
+bool Kernel::fold (Op op, const uint32_t* a, veclen len, uint32_t &acc) {
+  return hasAVX2 ? foldAVX2(op, a, len, acc)
+                 : foldBase(op, a, len, acc);
+}
+
+veclen Kernel::find (const char* hay, veclen len, const char* needle, veclen nLen) {
+  return hasAVX2 ? findAVX2(hay, len, needle, nLen)
+                 : findBase(hay, len, needle, nLen);
+}
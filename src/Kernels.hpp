@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include "Enums.hpp"
+
+//Vectorized loops over contiguous 32-bit numbers,
+//  using AVX2 when the CPU supports it, otherwise SSE2/scalar.
+//  Numbers are passed as their raw bits, either integers or floats.
+struct Kernel {
+  //out[i] = a[i] op b[i], or a[i] op b[0] if bScalar.
+  //  Returns false for an op without a kernel
+  static bool math (Op, bool isFloat, const uint32_t* a, const uint32_t* b,
+                    bool bScalar, uint32_t* out, veclen len);
+  //keep[i] = a[i] op c, or c op a[i] if swapped.
+  //  Equality ops compare bits, monotonic ops compare as floats
+  //  with c as the bits of a float
+  static bool mask (Op, bool isFloat, const uint32_t* a, uint32_t c,
+                    bool swapped, uint8_t* keep, veclen len);
+  //acc = acc op a[0] op a[1] ... over integers
+  static bool fold (Op, const uint32_t* a, veclen len, uint32_t &acc);
+  //Returns the index of the first needle in hay, or -1.
+  //  Candidates are found 32 bytes at a time by their first and last bytes
+  static veclen find (const char* hay, veclen len, const char* needle, veclen nLen);
+};
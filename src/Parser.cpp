@@ -51,8 +51,8 @@ string removeExtraneousSpace (const string& input) {
     //Handle extraneous spaces
     if (!inString && isWhite(c)) {
       bool doubleWhite       = isWhite(prev);
-      bool whiteAfterOpen    = prev == '(' || prev == '[';
-      bool whiteBeforeClose  = next == ')' || next == ']';
+      bool whiteAfterOpen    = prev == '(' || prev == '[' || prev == '{';
+      bool whiteBeforeClose  = next == ')' || next == ']' || next == '}';
       if (doubleWhite || whiteAfterOpen || whiteBeforeClose)
         continue;
     }
@@ -66,7 +66,7 @@ string removeExtraneousSpace (const string& input) {
 struct Token {
   enum {
     Unknown,
-    LParen, RParen, LSquare, RSquare,
+    LParen, RParen, LSquare, RSquare, LCurly, RCurly,
     Hash, Period, Para,
     Char, Number, String, Symbol
   } type;
@@ -77,7 +77,7 @@ vector<Token> tokenise (const string& input) {
   auto tokens = vector<Token>();
   for (uint16_t i = 0, iLen = input.length(); i < iLen; ++i) {
     char c = input[i];
-    //Handle # ( ) [ ]
+    //Handle # ( ) [ ] { }
     {
       auto type = Token::Unknown;
       switch (c) {
@@ -86,6 +86,8 @@ vector<Token> tokenise (const string& input) {
         case ')': type = Token::RParen;  break;
         case '[': type = Token::LSquare; break;
         case ']': type = Token::RSquare; break;
+        case '{': type = Token::LCurly;  break;
+        case '}': type = Token::RCurly;  break;
       }
       if (type != Token::Unknown) {
         tokens.push_back(Token{type, string(1, c)});
@@ -104,8 +106,8 @@ vector<Token> tokenise (const string& input) {
     if (c == ' ' || c == '\n')
       continue;
     //Collect next string before
-    //  space newline " ( ) [ ]
-    auto nextDelim = input.find_first_of(" \n\"()[]", i);
+    //  space newline " ( ) [ ] { }
+    auto nextDelim = input.find_first_of(" \n\"()[]{}", i);
     if (nextDelim == string::npos)
       nextDelim = input.length();
     string next = string(&input[i], &input[nextDelim]);
@@ -128,6 +130,15 @@ vector<Token> tokenise (const string& input) {
 }
 
 
+bool isOpen (Token &t) {
+  return t.type == Token::LParen || t.type == Token::LSquare || t.type == Token::LCurly;
+}
+
+bool isClose (Token &t) {
+  return t.type == Token::RParen || t.type == Token::RSquare || t.type == Token::RCurly;
+}
+
+
 //Separate all tokens by the highest level of parenthesis
 vector<vector<Token>> separate (vector<Token> tokens) {
   auto funcs = vector<vector<Token>>();
@@ -135,8 +146,8 @@ vector<vector<Token>> separate (vector<Token> tokens) {
   for (auto t : tokens) {
     if (!depth) funcs.push_back(vector<Token>());
     funcs.back().push_back(t);
-    if (t.type == Token::LParen || t.type == Token::LSquare) ++depth;
-    if (t.type == Token::RParen || t.type == Token::RSquare) --depth;
+    if (isOpen(t))  ++depth;
+    if (isClose(t)) --depth;
   }
   return funcs;
 }
@@ -149,6 +160,52 @@ Op symToOp (const char* symbol) {
   return O_None;
 }
 
+//Declare a record type's layout from its tokens, unless malformed,
+//  e.g. (defrecord Point [x y])
+void declareRecord (vector<Token> &form) {
+  auto isName = [](Token &t) {
+    return t.type == Token::Symbol && t.str.find('.') == string::npos;
+  };
+  if (form.size() < 6 || !isName(form[2]) || form[3].type != Token::LSquare)
+    return;
+  auto fields = vector<string>();
+  size_t t = 4;
+  for (; t < form.size() && isName(form[t]); ++t)
+    fields.push_back(form[t].str);
+  if (t + 2 != form.size() || form[t].type != Token::RSquare)
+    return;
+  Layout::add(form[2].str, fields);
+}
+
+//Return the Cells of a record type's name or field, resolved to its layout
+//  and slot: as an op and its leading arguments at the head of a form,
+//  otherwise as a lambda. Returns nullptr for any other symbol or a param
+//  e.g. Point => record id, Point.x => field id 0
+Cell* recordCells (const string &symbol, bool isHead, vector<string> &paras) {
+  if (find(paras.begin(), paras.end(), symbol) != paras.end()) return nullptr;
+  auto dot = symbol.find('.');
+  int32_t id = Layout::find(symbol.substr(0, dot));
+  if (id < 0) return nullptr;
+  auto &fields = Layout::at(id)->fields;
+  argnum numParas = fields.size();
+  Cell* head = new Cell{Value(Data{.op=O_Record}, T_Op)};
+  Cell* arg = head->next = new Cell{Value(Data{.u32=(uint32_t)id}, T_U32)};
+  if (dot != string::npos) {
+    auto f = find(fields.begin(), fields.end(), symbol.substr(dot + 1));
+    if (f == fields.end()) {
+      delete head;
+      return nullptr;
+    }
+    head->val = Value(Data{.op=O_Field}, T_Op);
+    arg = arg->next = new Cell{Value(Data{.u32=uint32_t(f - fields.begin())}, T_U32)};
+    numParas = 1;
+  }
+  if (isHead) return head;
+  for (argnum p = 0; p < numParas; ++p)
+    arg = arg->next = new Cell{Value(Data{.u08=p}, T_Para)};
+  return new Cell{Value(Data{.cell=head}, T_Lamb)};
+}
+
 //Take a vector of tokens and parameters,
 //  which constitutes one form,
 //  and return a root Cell
@@ -159,6 +216,12 @@ Cell* cellise (deque<Token> &tokens, vector<string> paras) {
   while (tokens.size()) {
     auto token = tokens.front();
     tokens.pop_front();
+    //Generate hash-set form for the following arguments
+    if (token.type == Token::Hash && tokens.size() && tokens.front().type == Token::LCurly) {
+      tokens.front() = Token{Token::Symbol, "hash-set"};
+      Cell* setForm = cellise(tokens, paras);
+      cell = new Cell{Value(Data{.cell=setForm}, T_Cell)};
+    } else
     //Recursively generate Cell for a form
     if (token.type == Token::LParen || token.type == Token::Hash) {
       bool isLambda = token.type == Token::Hash;
@@ -167,7 +230,7 @@ Cell* cellise (deque<Token> &tokens, vector<string> paras) {
       cell = new Cell{Value(Data{.cell=form}, isLambda ? T_Lamb : T_Cell)};
     } else
     //... or return this form's head
-    if (token.type == Token::RParen || token.type == Token::RSquare)
+    if (isClose(token))
       return head;
     else
     //... or generate vector form for the following arguments
@@ -175,7 +238,17 @@ Cell* cellise (deque<Token> &tokens, vector<string> paras) {
       tokens.push_front(Token{Token::Symbol, "vec"});
       Cell* vecForm = cellise(tokens, paras);
       cell = new Cell{Value(Data{.cell=vecForm}, T_Cell)};
-    } else {
+    } else
+    //... or generate hash-map form for the following arguments
+    if (token.type == Token::LCurly) {
+      tokens.push_front(Token{Token::Symbol, "hash-map"});
+      Cell* mapForm = cellise(tokens, paras);
+      cell = new Cell{Value(Data{.cell=mapForm}, T_Cell)};
+    } else
+    //... or generate Cells for a record type's name or field
+    if (Cell* rec = token.type == Token::Symbol ? recordCells(token.str, !head, paras) : nullptr)
+      cell = rec;
+    else {
     //... or generate Cell for this other type of argument
       Data data;
       Type type = T_N;
@@ -258,6 +331,8 @@ Cell* cellise (deque<Token> &tokens, vector<string> paras) {
     if (prev) prev->next = cell;
     prev = cell;
     if (!head) head = cell;
+    //A record op is followed by its leading arguments
+    while (prev->next) prev = prev->next;
   }
   return head;
 }
@@ -269,6 +344,9 @@ Cell* cellise (deque<Token> &tokens, vector<string> paras) {
 pair<fid, vector<Cell*>> cellise (vector<Token> form) {
   fid id = 0;
   auto paras = vector<string>();
+  //Record types are declared before parsing any form
+  if (form.size() > 1 && form[1].str == "defrecord")
+    return pair<fid, vector<Cell*>>(id, {});
   //Check if this is a function declaration
   //  or part of the entry function
   if (form.size() > 1 && form[1].str == "fn") {
@@ -287,8 +365,8 @@ pair<fid, vector<Cell*>> cellise (vector<Token> form) {
     uint8_t depth = 0;
     for (auto t : form) {
       formTokens.push_back(t);
-      if (t.type == Token::LParen || t.type == Token::LSquare) ++depth;
-      if (t.type == Token::RParen || t.type == Token::RSquare) --depth;
+      if (isOpen(t))  ++depth;
+      if (isClose(t)) --depth;
       if (!depth) {
         if (t.type == Token::LParen)
           formTokens.pop_front(); //Pop first paren
@@ -307,6 +385,9 @@ map<fid, vector<Cell*>> Parser::parse (string source) {
 //for (auto t : tokens) printf("%d %s\t", t.type, t.str.c_str());
 //printf("\n");
   auto separatedTokens = separate(tokens);
+  for (auto &tokens : separatedTokens)
+    if (tokens.size() > 3 && tokens[1].str == "defrecord")
+      declareRecord(tokens);
   auto funcs = map<fid, vector<Cell*>>();
   for (auto tokens : separatedTokens) {
     auto cells = cellise(tokens);
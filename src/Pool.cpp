@@ -0,0 +1,146 @@
+#include "Pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Range {
+  veclen from, to;
+};
+
+struct Deque {
+  mutex lock;
+  deque<Range> ranges;
+};
+
+//Threads are started on the first job and wait on this until exit,
+//  so it is never destroyed
+struct State {
+  vector<Deque> deques;
+  const Pool::Task* job = nullptr;
+  deque<function<void()>> tasks;
+  atomic<veclen> remaining {0};
+  uint64_t generation = 0;
+  mutex runLock, wakeLock;
+  condition_variable wake, done;
+  State (uint32_t n) : deques(n) {}
+};
+static State* state = new State(Pool::size());
+static thread_local bool isWorker = false; //Running a job's range
+static once_flag started;
+
+uint32_t Pool::size () {
+  static const uint32_t cores = max(thread::hardware_concurrency(), 1u);
+  return cores;
+}
+
+//Takes a range from the worker's own deque, else steals one
+static bool take (uint32_t w, Range &r) {
+  uint32_t n = Pool::size();
+  for (uint32_t i = 0; i < n; ++i) {
+    Deque &d = state->deques[(w + i) % n];
+    lock_guard<mutex> l(d.lock);
+    if (d.ranges.empty()) continue;
+    if (i) {
+      r = d.ranges.back();
+      d.ranges.pop_back();
+    } else {
+      r = d.ranges.front();
+      d.ranges.pop_front();
+    }
+    return true;
+  }
+  return false;
+}
+
+static void drain (uint32_t w) {
+  Range r;
+  while (take(w, r)) {
+    (*state->job)(w, r.from, r.to);
+    if (!(state->remaining -= r.to - r.from)) {
+      lock_guard<mutex> l(state->wakeLock);
+      state->done.notify_all();
+    }
+  }
+}
+
+static void work (uint32_t w) {
+  uint64_t seen = 0;
+  while (true) {
+    function<void()> task;
+    {
+      unique_lock<mutex> l(state->wakeLock);
+      state->wake.wait(l, [&] {
+        return state->generation != seen || state->tasks.size();
+      });
+      if (state->generation != seen)
+        seen = state->generation;
+      else {
+        task = move(state->tasks.front());
+        state->tasks.pop_front();
+      }
+    }
+    if (task) {
+      task();
+      continue;
+    }
+    isWorker = true;
+    drain(w);
+    isWorker = false;
+  }
+}
+
+static void startThreads () {
+  call_once(started, [] {
+    for (uint32_t w = 1; w < Pool::size(); ++w)
+      thread(work, w).detach();
+  });
+}
+
+void Pool::run (veclen len, Task task) {
+  if (len <= 0) return;
+  uint32_t n = size();
+  if (n == 1 || isWorker || !state->runLock.try_lock()) {
+    task(0, 0, len);
+    return;
+  }
+  startThreads();
+  //Several ranges per worker, so that early finishers can steal
+  veclen grain = max(len / veclen(n * 8), (veclen)1);
+  veclen perWorker = (len + n - 1) / n;
+  state->job = &task;
+  state->remaining = len;
+  for (uint32_t w = 0; w < n; ++w) {
+    Deque &d = state->deques[w];
+    lock_guard<mutex> l(d.lock);
+    veclen to = min(veclen(w + 1) * perWorker, len);
+    for (veclen from = w * perWorker; from < to; from += grain)
+      d.ranges.push_back(Range{from, min(from + grain, to)});
+  }
+  {
+    lock_guard<mutex> l(state->wakeLock);
+    ++state->generation;
+  }
+  state->wake.notify_all();
+  drain(0);
+  {
+    unique_lock<mutex> l(state->wakeLock);
+    state->done.wait(l, [] { return !state->remaining; });
+  }
+  state->job = nullptr;
+  state->runLock.unlock();
+}
+
+bool Pool::submit (function<void()> task) {
+  if (size() == 1) return false;
+  startThreads();
+  {
+    lock_guard<mutex> l(state->wakeLock);
+    state->tasks.push_back(move(task));
+  }
+  state->wake.notify_one();
+  return true;
+}
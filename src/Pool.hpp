@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include "Enums.hpp"
+using namespace std;
+
+//A thread per core which runs the index ranges of one job at a time,
+//  and otherwise runs queued tasks.
+//  Each thread takes ranges from the front of its own deque,
+//  and steals from the back of others' when its own is empty.
+class Pool {
+public:
+  typedef function<void(uint32_t, veclen, veclen)> Task; //Worker, from, to
+
+  //Workers, including the calling thread as worker 0
+  static uint32_t size ();
+  //Runs the task over [0, len) in ranges, returning once all are done.
+  //  Runs inline as worker 0 if called from a worker or during another job
+  static void run (veclen len, Task);
+  //Queues a task for the next idle thread.
+  //  Returns false, doing nothing, if there are no threads but the caller
+  static bool submit (function<void()>);
+};
@@ -0,0 +1,344 @@
+#include "Sort.hpp"
+#include "Pool.hpp"
+#include "Sorted.hpp"
+#include <algorithm>
+#include <cstring>
+
+const veclen INSERTION = 24;      //Ranges smaller than this are insertion sorted
+const veclen NINTHER   = 128;     //Ranges larger than this use a pseudomedian of 9
+const veclen PARALLEL  = 1 << 15; //Inputs larger than this are sorted in parallel
+
+//Numbers, then strings, then lists, then everything else by type
+static uint8_t orderOf (Type t) {
+  if (T_U08 <= t && t <= T_D32) return 0;
+  if (t == T_Str || t == T_Rope) return 1;
+  if (isVec(t) || t == T_Lizt) return 2;
+  return 3;
+}
+
+static double num (Value &v) {
+  switch (v.type()) {
+    case T_U08: return v.u08(); case T_S08: return v.s08();
+    case T_U32: return v.u32(); case T_S32: return v.s32();
+    default:    return v.d32();
+  }
+}
+
+//Returns the [key value] entries of a map or set, with N values for a set,
+//  in the order of their keys
+static vector<pair<Value, Value>> entriesOf (Value &v) {
+  auto items = vector<pair<Value, Value>>();
+  if (v.type() == T_Map)
+    for (auto &[key, val] : *hashMap(v))
+      items.push_back({key, val});
+  else if (v.type() == T_Set)
+    for (auto &item : *hashSet(v))
+      items.push_back({item, Value()});
+  else {
+    sorted(v)->each([&](const Value &key, const Value &val) {
+      items.push_back({key, val});
+    });
+    return items;
+  }
+  sort(items.begin(), items.end(), [](auto &x, auto &y) {
+    return Sort::compare(x.first, y.first) < 0;
+  });
+  return items;
+}
+
+int Sort::compare (Value &a, Value &b) {
+  uint8_t ra = orderOf(a.type()), rb = orderOf(b.type());
+  if (ra != rb) return ra < rb ? -1 : 1;
+  switch (ra) {
+    case 0: {
+      double x = num(a), y = num(b);
+      if (x != y) return x < y ? -1 : 1;
+      //Floats follow the integers they aren't alike to
+      return (a.type() == T_D32) - (b.type() == T_D32);
+    }
+    case 1: {
+      string holdA, holdB;
+      int c = strView(a, holdA).compare(strView(b, holdB));
+      return (c > 0) - (c < 0);
+    }
+    case 2: {
+      veclen lenA = Lizt::length(a), lenB = Lizt::length(b);
+      if (lenA != lenB) return lenA < lenB ? -1 : 1;
+      if (!isVec(a.type()) || !isVec(b.type())) return 0;
+      for (veclen i = 0; i < lenA; ++i) {
+        Value itemA = vecAt(a, i), itemB = vecAt(b, i);
+        if (int c = compare(itemA, itemB)) return c;
+      }
+      return 0;
+    }
+  }
+  if (a.type() != b.type()) return a.type() < b.type() ? -1 : 1;
+  switch (a.type()) {
+    //Maps and sets by size, then by entry in the order of their keys
+    case T_Map: case T_Set: case T_SMap: case T_SSet: {
+      auto entriesA = entriesOf(a), entriesB = entriesOf(b);
+      if (entriesA.size() != entriesB.size())
+        return entriesA.size() < entriesB.size() ? -1 : 1;
+      for (size_t i = 0; i < entriesA.size(); ++i) {
+        if (int c = compare(entriesA[i].first, entriesB[i].first)) return c;
+        if (int c = compare(entriesA[i].second, entriesB[i].second)) return c;
+      }
+      return 0;
+    }
+    //Records by type, then by field
+    case T_Rec: {
+      Record* recA = record(a), *recB = record(b);
+      if (recA->layout != recB->layout) return recA->layout < recB->layout ? -1 : 1;
+      for (uint16_t f = 0; f < recA->size; ++f)
+        if (int c = compare(recA->fields()[f], recB->fields()[f])) return c;
+      return 0;
+    }
+  }
+  return (a.u32() > b.u32()) - (a.u32() < b.u32());
+}
+
+bool Sort::less (Value &a, Value &b) {
+  return compare(a, b) < 0;
+}
+
+
+/// Pattern-defeating quicksort, of trivially copyable items
+
+template <class T, class L>
+static void sort2 (T* a, T* b, L &less) {
+  if (less(*b, *a)) swap(*a, *b);
+}
+
+template <class T, class L>
+static void sort3 (T* a, T* b, T* c, L &less) {
+  sort2(a, b, less);
+  sort2(b, c, less);
+  sort2(a, b, less);
+}
+
+//Insertion sorts, giving up after a number of moves if partial
+template <class T, class L>
+static bool insertion (T* begin, T* end, L &less, bool partial = false) {
+  if (begin == end) return true;
+  veclen moves = 0;
+  for (T* cur = begin + 1; cur != end; ++cur) {
+    T* sift = cur;
+    T* sift1 = cur - 1;
+    if (less(*sift, *sift1)) {
+      T tmp = *sift;
+      do *sift-- = *sift1;
+      while (sift != begin && less(tmp, *--sift1));
+      *sift = tmp;
+      moves += cur - sift;
+    }
+    if (partial && moves > 8) return false;
+  }
+  return true;
+}
+
+//Partitions around the pivot at begin, items less than it to the left.
+//  Returns its new position, and if no items were out of place
+template <class T, class L>
+static pair<T*, bool> partitionRight (T* begin, T* end, L &less) {
+  T pivot = *begin;
+  T* first = begin;
+  T* last = end;
+  //A median of 3 ensures an item not less than the pivot to the right
+  while (less(*++first, pivot));
+  if (first - 1 == begin)
+    while (first < last && !less(*--last, pivot));
+  else
+    while (!less(*--last, pivot));
+  bool wasPartitioned = first >= last;
+  while (first < last) {
+    swap(*first, *last);
+    while (less(*++first, pivot));
+    while (!less(*--last, pivot));
+  }
+  T* pivotPos = first - 1;
+  *begin = *pivotPos;
+  *pivotPos = pivot;
+  return {pivotPos, wasPartitioned};
+}
+
+//Partitions around the pivot at begin, items equal to it to the left
+template <class T, class L>
+static T* partitionLeft (T* begin, T* end, L &less) {
+  T pivot = *begin;
+  T* first = begin;
+  T* last = end;
+  while (less(pivot, *--last));
+  if (last + 1 == end)
+    while (first < last && !less(pivot, *++first));
+  else
+    while (!less(pivot, *++first));
+  while (first < last) {
+    swap(*first, *last);
+    while (less(pivot, *--last));
+    while (!less(pivot, *++first));
+  }
+  *begin = *last;
+  *last = pivot;
+  return last;
+}
+
+//Quicksort which detects sorted runs, moves runs of items equal to
+//  a previous pivot aside, shuffles on unbalanced partitions,
+//  and falls back to heapsort after too many
+template <class T, class L>
+static void pdq (T* begin, T* end, L &less, int badAllowed, bool leftmost = true) {
+  while (true) {
+    veclen size = end - begin;
+    if (size < INSERTION) {
+      insertion(begin, end, less);
+      return;
+    }
+    veclen half = size / 2;
+    if (size > NINTHER) {
+      sort3(begin, begin + half, end - 1, less);
+      sort3(begin + 1, begin + (half - 1), end - 2, less);
+      sort3(begin + 2, begin + (half + 1), end - 3, less);
+      sort3(begin + (half - 1), begin + half, begin + (half + 1), less);
+      swap(*begin, *(begin + half));
+    } else sort3(begin + half, begin, end - 1, less);
+    //The previous pivot is not less than this one, so all are equal to it
+    if (!leftmost && !less(*(begin - 1), *begin)) {
+      begin = partitionLeft(begin, end, less) + 1;
+      continue;
+    }
+    auto [pivotPos, wasPartitioned] = partitionRight(begin, end, less);
+    veclen l = pivotPos - begin, r = end - (pivotPos + 1);
+    if (l < size / 8 || r < size / 8) {
+      if (!--badAllowed) {
+        make_heap(begin, end, less);
+        sort_heap(begin, end, less);
+        return;
+      }
+      if (l >= INSERTION) {
+        swap(*begin, *(begin + l / 4));
+        swap(*(pivotPos - 1), *(pivotPos - l / 4));
+        if (l > NINTHER) {
+          swap(*(begin + 1), *(begin + (l / 4 + 1)));
+          swap(*(begin + 2), *(begin + (l / 4 + 2)));
+          swap(*(pivotPos - 2), *(pivotPos - (l / 4 + 1)));
+          swap(*(pivotPos - 3), *(pivotPos - (l / 4 + 2)));
+        }
+      }
+      if (r >= INSERTION) {
+        swap(*(pivotPos + 1), *(pivotPos + (1 + r / 4)));
+        swap(*(end - 1), *(end - r / 4));
+        if (r > NINTHER) {
+          swap(*(pivotPos + 2), *(pivotPos + (2 + r / 4)));
+          swap(*(pivotPos + 3), *(pivotPos + (3 + r / 4)));
+          swap(*(end - 2), *(end - (1 + r / 4)));
+          swap(*(end - 3), *(end - (2 + r / 4)));
+        }
+      }
+    } else if (wasPartitioned
+            && insertion(begin, pivotPos, less, true)
+            && insertion(pivotPos + 1, end, less, true))
+      return;
+    pdq(begin, pivotPos, less, badAllowed, leftmost);
+    begin = pivotPos + 1;
+    leftmost = false;
+  }
+}
+
+template <class T, class L>
+static void pdqsort (T* begin, T* end, L &less) {
+  int log2 = 0;
+  for (veclen n = end - begin; n > 1; n >>= 1) ++log2;
+  pdq(begin, end, less, log2 + 1);
+}
+
+
+void Sort::byKeys (vector<Value> &keys, vector<uint32_t> &order) {
+  //Ties are broken by index, so that the sort is stable
+  auto less = [&](uint32_t a, uint32_t b) {
+    if (Sort::less(keys[a], keys[b])) return true;
+    return !Sort::less(keys[b], keys[a]) && a < b;
+  };
+  veclen len = order.size();
+  veclen chunks = Pool::size();
+  if (len < PARALLEL || chunks == 1) {
+    pdqsort(order.data(), order.data() + len, less);
+    return;
+  }
+  //Sort a range per worker, then merge pairs of ranges in rounds.
+  //  Comparing copies nested Values, so ARC is atomic meanwhile
+  auto bounds = vector<veclen>(chunks + 1);
+  for (veclen c = 0; c <= chunks; ++c)
+    bounds[c] = (int64_t)len * c / chunks;
+  uint32_t* src = order.data();
+  Heap* callerHeap = heap;
+  ++heap->shared;
+  Pool::run(chunks, [&](uint32_t, veclen from, veclen to) {
+    heap = callerHeap;
+    for (veclen c = from; c < to; ++c)
+      pdqsort(src + bounds[c], src + bounds[c + 1], less);
+  });
+  auto buf = vector<uint32_t>(len);
+  uint32_t* dst = buf.data();
+  for (veclen width = 1; width < chunks; width *= 2) {
+    veclen pairs = (chunks + 2 * width - 1) / (2 * width);
+    Pool::run(pairs, [&](uint32_t, veclen from, veclen to) {
+      heap = callerHeap;
+      for (veclen p = from; p < to; ++p) {
+        veclen lo  = bounds[p * 2 * width];
+        veclen mid = bounds[min(p * 2 * width + width, chunks)];
+        veclen hi  = bounds[min(p * 2 * width + 2 * width, chunks)];
+        merge(src + lo, src + mid, src + mid, src + hi, dst + lo, less);
+      }
+    });
+    swap(src, dst);
+  }
+  --heap->shared;
+  if (src != order.data())
+    memcpy(order.data(), src, len * sizeof(uint32_t));
+}
+
+
+//Maps the bits of a number to an unsigned integer of the same order
+static uint32_t radixKey (uint32_t bits, Type t) {
+  if (t == T_S32) return bits ^ 0x80000000;
+  if (t == T_D32) return bits & 0x80000000 ? ~bits : bits | 0x80000000;
+  return bits;
+}
+
+//Least significant digit first, skipping digits which are all the same
+void Sort::radix (uint32_t* keys, uint32_t* order, veclen len, Type t) {
+  auto buf = vector<uint32_t>(len), orderBuf = vector<uint32_t>(order ? len : 0);
+  for (veclen i = 0; i < len; ++i)
+    keys[i] = radixKey(keys[i], t);
+  uint32_t *src = keys, *dst = buf.data();
+  uint32_t *oSrc = order, *oDst = orderBuf.data();
+  for (uint8_t shift = 0; shift < 32; shift += 8) {
+    veclen counts[256] = {0};
+    for (veclen i = 0; i < len; ++i)
+      ++counts[(src[i] >> shift) & 0xFF];
+    if (counts[(src[0] >> shift) & 0xFF] == len) continue;
+    veclen at = 0;
+    for (auto &c : counts) {
+      veclen n = c;
+      c = at;
+      at += n;
+    }
+    for (veclen i = 0; i < len; ++i) {
+      veclen to = counts[(src[i] >> shift) & 0xFF]++;
+      dst[to] = src[i];
+      if (order) oDst[to] = oSrc[i];
+    }
+    swap(src, dst);
+    swap(oSrc, oDst);
+  }
+  if (src != keys) {
+    memcpy(keys, src, len * sizeof(uint32_t));
+    if (order) memcpy(order, oSrc, len * sizeof(uint32_t));
+  }
+  //Restore the bits
+  for (veclen i = 0; i < len; ++i)
+    switch (t) {
+      case T_S32: keys[i] ^= 0x80000000; break;
+      case T_D32: keys[i] = keys[i] & 0x80000000 ? keys[i] ^ 0x80000000 : ~keys[i]; break;
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Cell.hpp"
+using namespace std;
+
+//Sorts of indices into keys, and radix sorts of raw numbers
+struct Sort {
+  //Orders numbers by value, then strings by bytes, then lists by length
+  //  then item, then other values by type: maps and sets by size then
+  //  entry, records by field, others by bits. Returns -1, 0 or 1
+  static int  compare (Value&, Value&);
+  static bool less    (Value&, Value&);
+  //Stably sorts order, indices into keys, with a pattern-defeating
+  //  quicksort, or for large inputs sorts ranges in parallel then merges them
+  static void byKeys (vector<Value> &keys, vector<uint32_t> &order);
+  //Stably sorts the bits of 32-bit numbers of one type,
+  //  and order alongside them if it isn't null
+  static void radix (uint32_t* keys, uint32_t* order, veclen len, Type);
+};
@@ -0,0 +1,248 @@
+#include "Sorted.hpp"
+#include "Sort.hpp"
+
+static int cmp (const Value &a, const Value &b) {
+  return Sort::compare(const_cast<Value&>(a), const_cast<Value&>(b));
+}
+
+//Returns the index of the first key not less than the key
+static veclen lowerBound (const vector<Value> &keys, Value &key, bool orEqual = false) {
+  veclen lo = 0, hi = keys.size();
+  while (lo < hi) {
+    veclen mid = (lo + hi) / 2;
+    int c = cmp(keys[mid], key);
+    if (c < 0 || (orEqual && !c)) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+//Returns the index of the child whose keys would include the key
+static veclen childOf (const vector<Value> &keys, Value &key) {
+  return max(lowerBound(keys, key, true) - 1, (veclen)0);
+}
+
+
+Sorted::Sorted (bool _isMap) : root(make_shared<Node>()), isMap(_isMap) {}
+
+Sorted::Sorted (bool _isMap, vector<Value> &keys, vector<Value> &vals)
+  : isMap(_isMap) {
+  veclen len = keys.size();
+  auto order = vector<uint32_t>(len);
+  for (veclen i = 0; i < len; ++i)
+    order[i] = i;
+  Sort::byKeys(keys, order);
+  //Fill leaves, keeping the last of equal keys
+  auto level = vector<NodeP>();
+  shared_ptr<Node> leaf;
+  for (veclen i = 0; i < len; ++i) {
+    uint32_t o = order[i];
+    if (i + 1 < len && !cmp(keys[o], keys[order[i + 1]]))
+      continue;
+    if (!leaf || leaf->keys.size() == SORTED_ORDER) {
+      level.push_back(leaf = make_shared<Node>());
+      leaf->keys.reserve(SORTED_ORDER);
+    }
+    leaf->keys.push_back(keys[o]);
+    if (isMap) leaf->vals.push_back(vals[o]);
+    ++leaf->count;
+  }
+  //Then each level of parents
+  while (level.size() > 1) {
+    auto parents = vector<NodeP>();
+    for (veclen i = 0, iLen = level.size(); i < iLen; i += SORTED_ORDER)
+      parents.push_back(parent(level, i, min(i + SORTED_ORDER, iLen)));
+    level = parents;
+  }
+  root = level.size() ? level[0] : make_shared<Node>();
+}
+
+Sorted::NodeP Sorted::parent (vector<NodeP> &kids, veclen from, veclen to) {
+  auto n = make_shared<Node>();
+  for (veclen i = from; i < to; ++i) {
+    n->keys.push_back(kids[i]->keys[0]);
+    n->kids.push_back(kids[i]);
+    n->count += kids[i]->count;
+  }
+  return n;
+}
+
+//Copies the keys, and values or children, of a range of a node
+Sorted::NodeP Sorted::slice (const Node &src, veclen from, veclen to) {
+  auto n = make_shared<Node>();
+  n->keys.assign(src.keys.begin() + from, src.keys.begin() + to);
+  if (src.vals.size())
+    n->vals.assign(src.vals.begin() + from, src.vals.begin() + to);
+  if (src.isLeaf()) {
+    n->count = to - from;
+    return n;
+  }
+  n->kids.assign(src.kids.begin() + from, src.kids.begin() + to);
+  for (auto &k : n->kids)
+    n->count += k->count;
+  return n;
+}
+
+//Merges a child with the next, splitting them evenly if too large
+void Sorted::merge (Node &n, veclen at) {
+  Node both = *n.kids[at];
+  const Node &next = *n.kids[at + 1];
+  both.keys.insert(both.keys.end(), next.keys.begin(), next.keys.end());
+  both.vals.insert(both.vals.end(), next.vals.begin(), next.vals.end());
+  both.kids.insert(both.kids.end(), next.kids.begin(), next.kids.end());
+  veclen len = both.keys.size();
+  n.keys.erase(n.keys.begin() + at + 1);
+  n.kids.erase(n.kids.begin() + at + 1);
+  if (len <= SORTED_ORDER) {
+    n.kids[at] = slice(both, 0, len);
+    return;
+  }
+  n.kids[at] = slice(both, 0, len / 2);
+  n.kids.insert(n.kids.begin() + at + 1, slice(both, len / 2, len));
+  n.keys.insert(n.keys.begin() + at + 1, n.kids[at + 1]->keys[0]);
+}
+
+//Returns the node with the key set, split in two if it became too large,
+//  or the node itself if unchanged
+vector<Sorted::NodeP> Sorted::with (const NodeP &node, Value &key, Value &val, bool isMap) {
+  shared_ptr<Node> n;
+  if (node->isLeaf()) {
+    veclen at = lowerBound(node->keys, key);
+    bool has = at < (veclen)node->keys.size() && !cmp(node->keys[at], key);
+    if (has && !isMap) return {node};
+    n = make_shared<Node>(*node);
+    if (has) n->vals[at] = val;
+    else {
+      n->keys.insert(n->keys.begin() + at, key);
+      if (isMap) n->vals.insert(n->vals.begin() + at, val);
+      ++n->count;
+    }
+  } else {
+    veclen at = childOf(node->keys, key);
+    auto kids = with(node->kids[at], key, val, isMap);
+    if (kids[0] == node->kids[at]) return {node};
+    n = make_shared<Node>(*node);
+    n->count -= node->kids[at]->count;
+    for (auto &k : kids)
+      n->count += k->count;
+    n->kids[at] = kids[0];
+    n->keys[at] = kids[0]->keys[0];
+    if (kids.size() == 2) {
+      n->kids.insert(n->kids.begin() + at + 1, kids[1]);
+      n->keys.insert(n->keys.begin() + at + 1, kids[1]->keys[0]);
+    }
+  }
+  veclen len = n->keys.size();
+  if (len <= SORTED_ORDER) return {n};
+  return {slice(*n, 0, len / 2), slice(*n, len / 2, len)};
+}
+
+//Returns the node without the key, merging a child with its neighbour
+//  if it became small, or the node itself if the key wasn't found
+Sorted::NodeP Sorted::without (const NodeP &node, Value &key, bool &found) {
+  shared_ptr<Node> n;
+  if (node->isLeaf()) {
+    veclen at = lowerBound(node->keys, key);
+    if (at == (veclen)node->keys.size() || cmp(node->keys[at], key)) {
+      found = false;
+      return node;
+    }
+    n = make_shared<Node>(*node);
+    n->keys.erase(n->keys.begin() + at);
+    if (n->vals.size()) n->vals.erase(n->vals.begin() + at);
+  } else {
+    veclen at = childOf(node->keys, key);
+    NodeP kid = without(node->kids[at], key, found);
+    if (!found) return node;
+    n = make_shared<Node>(*node);
+    if (kid->keys.empty()) {
+      n->keys.erase(n->keys.begin() + at);
+      n->kids.erase(n->kids.begin() + at);
+    } else {
+      n->kids[at] = kid;
+      n->keys[at] = kid->keys[0];
+      if (kid->keys.size() < SORTED_ORDER / 4 && n->kids.size() > 1)
+        merge(*n, min(at, (veclen)n->kids.size() - 2));
+    }
+  }
+  --n->count;
+  return n;
+}
+
+
+veclen Sorted::size () const {
+  return root->count;
+}
+
+const Value* Sorted::find (Value &key) const {
+  const Node* n = root.get();
+  while (!n->isLeaf())
+    n = n->kids[childOf(n->keys, key)].get();
+  veclen at = lowerBound(n->keys, key);
+  if (at == (veclen)n->keys.size() || cmp(n->keys[at], key))
+    return nullptr;
+  return isMap ? &n->vals[at] : &n->keys[at];
+}
+
+Sorted Sorted::with (Value key, Value val) const {
+  Sorted s = *this;
+  auto kids = with(root, key, val, isMap);
+  s.root = kids.size() == 1 ? kids[0] : parent(kids, 0, 2);
+  return s;
+}
+
+Sorted Sorted::without (Value key) const {
+  Sorted s = *this;
+  bool found = true;
+  s.root = without(root, key, found);
+  //Shorten the tree while the root has one child
+  while (!s.root->isLeaf() && s.root->kids.size() == 1)
+    s.root = s.root->kids[0];
+  if (s.root->keys.empty())
+    s.root = make_shared<Node>();
+  return s;
+}
+
+veclen Sorted::rank (Value &key, bool orEqual) const {
+  veclen r = 0;
+  const Node* n = root.get();
+  while (!n->isLeaf()) {
+    veclen at = childOf(n->keys, key);
+    for (veclen k = 0; k < at; ++k)
+      r += n->kids[k]->count;
+    n = n->kids[at].get();
+  }
+  return r + lowerBound(n->keys, key, orEqual);
+}
+
+pair<Value, Value> Sorted::at (veclen i) const {
+  const Node* n = root.get();
+  while (!n->isLeaf())
+    for (auto &k : n->kids) {
+      if (i < k->count) {
+        n = k.get();
+        break;
+      }
+      i -= k->count;
+    }
+  return {n->keys[i], isMap ? n->vals[i] : Value()};
+}
+
+void Sorted::each (function<void(const Value&, const Value&)> f) const {
+  auto visit = [&](auto &self, const Node* n) -> void {
+    if (n->isLeaf()) {
+      Value none;
+      for (size_t i = 0; i < n->keys.size(); ++i)
+        f(n->keys[i], n->vals.size() ? n->vals[i] : none);
+      return;
+    }
+    for (auto &k : n->kids)
+      self(self, k.get());
+  };
+  visit(visit, root.get());
+}
+
+
+Sorted* sorted (Value &v) {
+  return (Sorted*)v.ptr();
+}
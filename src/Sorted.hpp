@@ -0,0 +1,50 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <vector>
+#include "Cell.hpp"
+using namespace std;
+
+const uint8_t SORTED_ORDER = 32; //Most keys or children per B+tree node
+
+//A persistent B+tree of keys, with values if a map, in Sort::compare order.
+//  Nodes are shared between versions, and copied along the changed path.
+//  Each node counts the keys beneath it, so keys are also found by index
+class Sorted {
+  struct Node {
+    vector<Value> keys; //Of a leaf, or the least key beneath each child
+    vector<Value> vals; //Of a map leaf
+    vector<shared_ptr<const Node>> kids;
+    veclen count = 0;   //Keys beneath
+    bool isLeaf () const { return kids.empty(); }
+  };
+  typedef shared_ptr<const Node> NodeP;
+
+  NodeP root;
+
+  static vector<NodeP> with    (const NodeP&, Value&, Value&, bool);
+  static NodeP         without (const NodeP&, Value&, bool&);
+  static NodeP         slice   (const Node&, veclen, veclen);
+  static void          merge   (Node&, veclen);
+  static NodeP         parent  (vector<NodeP>&, veclen, veclen);
+
+public:
+  bool isMap;
+
+  Sorted (bool isMap);
+  //Builds from keys and values in any order, later keys replacing earlier
+  Sorted (bool isMap, vector<Value> &keys, vector<Value> &vals);
+  veclen size () const;
+  //Returns the value of a key, or the key itself of a set, or nullptr
+  const Value* find (Value&) const;
+  Sorted with    (Value key, Value val) const;
+  Sorted without (Value key) const;
+  //Returns the number of keys less than the key, or also equal to it
+  veclen rank (Value&, bool orEqual = false) const;
+  //Returns the key and value at an index
+  pair<Value, Value> at (veclen) const;
+  //Calls f with each key and value in order
+  void each (function<void(const Value&, const Value&)> f) const;
+};
+
+Sorted* sorted (Value&);
@@ -6,8 +6,34 @@
 #include "keypresses.c"
 #include "Parser.hpp"
 #include "EVM.hpp"
+#include "Isolate.hpp"
 using namespace std;
 
+//Evaluation limits from the command line, applied per evaluation
+uint64_t fuel = 0;
+uint32_t timeout = 0, maxDepth = 0;
+
+const char* const halts[] = {
+  "", "out of fuel", "out of time", "too deep"
+};
+
+//Evaluates the entry function, printing its result if asked. The result
+//  is made a string before checking the limits, as realizing a lazy
+//  result may exceed them. A halted evaluation returns N
+Value evaluate (EVM &vm, Cell* params, bool printResult) {
+  vm.setLimits(fuel, timeout, maxDepth);
+  auto ret = vm.exeFunc(0, params);
+  string str = printResult ? vm.toStr(ret) : "";
+  vm.settle();
+  if (vm.halted()) {
+    printf("Halted: %s.\n", halts[vm.halted()]);
+    return Value();
+  }
+  if (printResult)
+    printf("%s\n", str.c_str());
+  return ret;
+}
+
 bool parseAndLoad (EVM &vm, string input) {
   bool hasEntry = false;
   for (auto func : Parser::parse(input)) {
@@ -17,6 +43,32 @@ bool parseAndLoad (EVM &vm, string input) {
   return hasEntry;
 }
 
+string readFile (string path) {
+  ifstream infile{path};
+  return {istreambuf_iterator<char>(infile), istreambuf_iterator<char>()};
+}
+
+//Runs each script concurrently in its own isolate, each receiving what
+//  the previous one sends, then prints their output in order
+void runIsolates (vector<string> paths, bool printResult) {
+  auto isolates = vector<unique_ptr<Isolate>>();
+  for (auto &path : paths) {
+    isolates.push_back(make_unique<Isolate>(readFile(path)));
+    if (isolates.size() > 1)
+      isolates.back()->inbox = isolates[isolates.size() - 2]->outbox;
+  }
+  for (auto &iso : isolates)
+    iso->start(fuel, timeout, maxDepth, printResult);
+  for (auto &iso : isolates) {
+    iso->join();
+    printf("%s", iso->output.c_str());
+    if (iso->halted())
+      printf("Halted: %s.\n", halts[iso->halted()]);
+    else if (printResult)
+      printf("%s\n", iso->resultStr.c_str());
+  }
+}
+
 void repl () {
   printf("Ephem REPL. %% gives previous result. Arrow keys navigate history/entry. q or ^C to quit.\n");
   EVM vm = EVM(Env());
@@ -34,24 +86,33 @@ void repl () {
     }
     vm.removeFunc(0);
     if (parseAndLoad(vm, input)) {
-      Cell* evaled = new Cell{vm.exeFunc(0, previous)};
+      Cell* evaled = new Cell{evaluate(vm, previous, true)};
       delete previous;
       previous = evaled;
-      printf("%s\n", vm.toStr(evaled->val).c_str());
     }
   }
   delete previous;
 }
 
+//Usage: ephem [file… [-r]] [-f fuel] [-t milliseconds] [-d depth]
 int main (int argc, char *argv[]) {
   kb_listen();
-  if (argc > 1) {
-    ifstream infile{string(argv[1])};
+  auto paths = vector<string>();
+  bool printResult = false;
+  for (int a = 1; a < argc; ++a) {
+    string arg = argv[a];
+    if (arg == "-r") printResult = true;
+    else if (a + 1 < argc && arg == "-f") fuel     = stoull(argv[++a]);
+    else if (a + 1 < argc && arg == "-t") timeout  = stoul(argv[++a]);
+    else if (a + 1 < argc && arg == "-d") maxDepth = stoul(argv[++a]);
+    else paths.push_back(arg);
+  }
+  if (paths.size() > 1)
+    runIsolates(paths, printResult);
+  else if (paths.size()) {
     EVM vm = EVM(Env());
-    parseAndLoad(vm, {istreambuf_iterator<char>(infile), istreambuf_iterator<char>()});
-    auto ret = vm.exeFunc(0, nullptr);
-    if (argc == 3 && string(argv[2]) == "-r")
-      printf("%s\n", vm.toStr(ret).c_str());
+    parseAndLoad(vm, readFile(paths[0]));
+    evaluate(vm, nullptr, printResult);
   } else repl();
 
   if (Cell::checkMemLeak())